@@ -0,0 +1,172 @@
+#include "bitmap.h"
+
+#include <algorithm>
+#include <bitset>
+
+using namespace std;
+
+Bitmap::Bitmap() = default;
+
+void Bitmap::Set(size_t index) {
+  vector<uint64_t> &words = GetWords(index / CHUNK_BITS);
+  const size_t word = index / WORD_BITS % CHUNK_WORDS;
+  if (word >= words.size()) {
+    // Grow geometrically, ids are usually added in increasing order
+    words.reserve(min(max(word + 1, words.size() * 2), CHUNK_WORDS));
+    words.resize(word + 1);
+  }
+  words[word] |= uint64_t{1} << (index % WORD_BITS);
+}
+
+void Bitmap::Reset(size_t index) {
+  const Chunk *chunk = FindChunk(index / CHUNK_BITS);
+  const size_t word = index / WORD_BITS % CHUNK_WORDS;
+  if (chunk && word < chunk->words.size()) {
+    chunks_[chunk - chunks_.data()].words[word] &= ~(uint64_t{1} << (index % WORD_BITS));
+  }
+}
+
+size_t Bitmap::Count() const {
+  size_t count = 0;
+  for (const Chunk &chunk : chunks_) {
+    for (const uint64_t word : chunk.words) {
+      count += bitset<WORD_BITS>(word).count();
+    }
+  }
+  return count;
+}
+
+bool Bitmap::None() const {
+  return all_of(chunks_.begin(), chunks_.end(), [](const Chunk &chunk) {
+    return all_of(chunk.words.begin(), chunk.words.end(), [](uint64_t word) { return word == 0; });
+  });
+}
+
+void Bitmap::SetWord(size_t word_index, uint64_t word) {
+  const size_t chunk_index = word_index / CHUNK_WORDS;
+  if (word == 0 && !FindChunk(chunk_index)) {
+    return;
+  }
+  vector<uint64_t> &words = GetWords(chunk_index);
+  const size_t chunk_word = word_index % CHUNK_WORDS;
+  if (chunk_word >= words.size()) {
+    if (word == 0) {
+      return;
+    }
+    words.resize(chunk_word + 1);
+  }
+  words[chunk_word] = word;
+}
+
+void Bitmap::Crop(size_t begin, size_t end) {
+  if (begin >= end) {
+    chunks_.clear();
+    return;
+  }
+  chunks_.erase(remove_if(chunks_.begin(), chunks_.end(), [begin, end](const Chunk &chunk) {
+    return (chunk.index + 1) * CHUNK_BITS <= begin || chunk.index * CHUNK_BITS >= end;
+  }), chunks_.end());
+  for (Chunk &chunk : chunks_) {
+    for (size_t word = 0; word < chunk.words.size(); ++word) {
+      const size_t first = (chunk.index * CHUNK_WORDS + word) * WORD_BITS;
+      if (first >= begin && first + WORD_BITS <= end) {
+        continue;
+      }
+      for (size_t bit = 0; bit < WORD_BITS; ++bit) {
+        if (first + bit < begin || first + bit >= end) {
+          chunk.words[word] &= ~(uint64_t{1} << bit);
+        }
+      }
+    }
+  }
+}
+
+Bitmap &Bitmap::operator&=(const Bitmap &other) {
+  vector<Chunk> chunks;
+  auto other_it = other.chunks_.begin();
+  for (Chunk &chunk : chunks_) {
+    while (other_it != other.chunks_.end() && other_it->index < chunk.index) {
+      ++other_it;
+    }
+    if (other_it == other.chunks_.end()) {
+      break;
+    }
+    if (other_it->index != chunk.index) {
+      continue;
+    }
+    chunk.words.resize(min(chunk.words.size(), other_it->words.size()));
+    for (size_t i = 0; i < chunk.words.size(); ++i) {
+      chunk.words[i] &= other_it->words[i];
+    }
+    chunks.push_back(move(chunk));
+  }
+  chunks_ = move(chunks);
+  return *this;
+}
+
+Bitmap &Bitmap::operator|=(const Bitmap &other) {
+  vector<Chunk> chunks;
+  chunks.reserve(max(chunks_.size(), other.chunks_.size()));
+  auto it = chunks_.begin();
+  auto other_it = other.chunks_.begin();
+  while (it != chunks_.end() || other_it != other.chunks_.end()) {
+    if (other_it == other.chunks_.end() || (it != chunks_.end() && it->index < other_it->index)) {
+      chunks.push_back(move(*it++));
+      continue;
+    }
+    if (it == chunks_.end() || other_it->index < it->index) {
+      chunks.push_back(*other_it++);
+      continue;
+    }
+    Chunk &chunk = chunks.emplace_back(move(*it++));
+    if (chunk.words.size() < other_it->words.size()) {
+      chunk.words.resize(other_it->words.size());
+    }
+    for (size_t i = 0; i < other_it->words.size(); ++i) {
+      chunk.words[i] |= other_it->words[i];
+    }
+    ++other_it;
+  }
+  chunks_ = move(chunks);
+  return *this;
+}
+
+Bitmap &Bitmap::Subtract(const Bitmap &other) {
+  auto other_it = other.chunks_.begin();
+  for (Chunk &chunk : chunks_) {
+    while (other_it != other.chunks_.end() && other_it->index < chunk.index) {
+      ++other_it;
+    }
+    if (other_it == other.chunks_.end()) {
+      break;
+    }
+    if (other_it->index != chunk.index) {
+      continue;
+    }
+    const size_t word_count = min(chunk.words.size(), other_it->words.size());
+    for (size_t i = 0; i < word_count; ++i) {
+      chunk.words[i] &= ~other_it->words[i];
+    }
+  }
+  return *this;
+}
+
+const Bitmap::Chunk *Bitmap::SearchChunk(size_t chunk_index) const {
+  const auto it = lower_bound(chunks_.begin(), chunks_.end(), chunk_index, [](const Chunk &chunk, size_t index) {
+    return chunk.index < index;
+  });
+  return it != chunks_.end() && it->index == chunk_index ? &*it : nullptr;
+}
+
+vector<uint64_t> &Bitmap::GetWords(size_t chunk_index) {
+  if (chunk_index < chunks_.size() && chunks_[chunk_index].index == chunk_index) {
+    return chunks_[chunk_index].words;
+  }
+  const auto it = lower_bound(chunks_.begin(), chunks_.end(), chunk_index, [](const Chunk &chunk, size_t index) {
+    return chunk.index < index;
+  });
+  if (it != chunks_.end() && it->index == chunk_index) {
+    return it->words;
+  }
+  return chunks_.insert(it, Chunk{chunk_index, {}})->words;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Growable set of non-negative integers (document ids) packed 64 per word. Words are grouped
+// into chunks of CHUNK_WORDS and only chunks holding set bits are allocated, so memory follows
+// the ids in use rather than the largest one
+class Bitmap {
+ public:
+  static const size_t WORD_BITS = 64;
+  static constexpr size_t CHUNK_WORDS = 1024;
+  static constexpr size_t CHUNK_BITS = WORD_BITS * CHUNK_WORDS;
+
+  Bitmap();
+
+  void Set(size_t index);
+
+  void Reset(size_t index);
+
+  bool Test(size_t index) const {
+    const Chunk *chunk = FindChunk(index / CHUNK_BITS);
+    if (!chunk) {
+      return false;
+    }
+    const size_t word = index / WORD_BITS % CHUNK_WORDS;
+    return word < chunk->words.size() && (chunk->words[word] >> (index % WORD_BITS) & 1u);
+  }
+
+  size_t Count() const;
+
+  bool None() const;
+
+  // Overwrites bits [word_index * 64, word_index * 64 + 64), used by column scans
+  void SetWord(size_t word_index, uint64_t word);
+
+  // Clears every bit outside [begin, end)
+  void Crop(size_t begin, size_t end);
+
+  Bitmap &operator&=(const Bitmap &other);
+
+  Bitmap &operator|=(const Bitmap &other);
+
+  // Clears every bit that is set in other
+  Bitmap &Subtract(const Bitmap &other);
+
+ private:
+  struct Chunk {
+    size_t index;
+    // Grows up to CHUNK_WORDS as higher bits of the chunk are set
+    std::vector<uint64_t> words;
+  };
+
+  // Sorted by index. While ids are dense, chunk i sits at position i and lookups skip the search
+  std::vector<Chunk> chunks_;
+
+  const Chunk *FindChunk(size_t chunk_index) const {
+    if (chunk_index < chunks_.size() && chunks_[chunk_index].index == chunk_index) {
+      return &chunks_[chunk_index];
+    }
+    return SearchChunk(chunk_index);
+  }
+
+  const Chunk *SearchChunk(size_t chunk_index) const;
+
+  std::vector<uint64_t> &GetWords(size_t chunk_index);
+};
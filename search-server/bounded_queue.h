@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Blocking multi-producer multi-consumer queue holding at most capacity items
+template<typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity);
+
+  // Blocks while the queue is full, returns false if the queue is closed
+  bool Push(T item);
+
+  // Blocks while the queue is empty, returns nullopt once the queue is closed and drained
+  std::optional<T> Pop();
+
+  void Close();
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> items_;
+  size_t capacity_;
+  bool is_closed_ = false;
+};
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) : capacity_(capacity) {
+}
+
+template<typename T>
+bool BoundedQueue<T>::Push(T item) {
+  std::unique_lock lock(mutex_);
+  not_full_.wait(lock, [this] { return is_closed_ || items_.size() < capacity_; });
+  if (is_closed_) {
+    return false;
+  }
+  items_.push_back(std::move(item));
+  not_empty_.notify_one();
+  return true;
+}
+
+template<typename T>
+std::optional<T> BoundedQueue<T>::Pop() {
+  std::unique_lock lock(mutex_);
+  not_empty_.wait(lock, [this] { return is_closed_ || !items_.empty(); });
+  if (items_.empty()) {
+    return std::nullopt;
+  }
+  T item = std::move(items_.front());
+  items_.pop_front();
+  not_full_.notify_one();
+  return item;
+}
+
+template<typename T>
+void BoundedQueue<T>::Close() {
+  std::lock_guard guard(mutex_);
+  is_closed_ = true;
+  not_full_.notify_all();
+  not_empty_.notify_all();
+}
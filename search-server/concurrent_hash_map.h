@@ -0,0 +1,151 @@
+#pragma once
+
+#include "hash.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <execution>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std::string_literals;
+
+// Slots drained by one task of a parallel Drain
+const size_t CONCURRENT_HASH_MAP_DRAIN_CHUNK_SIZE = 4096;
+
+// Lock-free map of a fixed capacity with linear probing, for accumulating values from many
+// threads. A key is claimed with a CAS on its slot state and published before any addition
+// reads it; values are added with a CAS loop, so doubles are supported
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentHashMap {
+ public:
+  static_assert(std::is_arithmetic_v<Value>, "ConcurrentHashMap accumulates arithmetic values only");
+
+  // Holds up to max_key_count keys at a load factor of at most one half
+  explicit ConcurrentHashMap(size_t max_key_count)
+      : slots_(GetSlotCount(max_key_count)),
+        slot_mask_(slots_.size() - 1) {
+  }
+
+  // Throws length_error if more than max_key_count distinct keys are added
+  void FetchAdd(const Key &key, Value addend) {
+    Slot &slot = *FindSlot(key, true);
+    if (slot.state.load(std::memory_order_acquire) == ERASED) {
+      return;
+    }
+    Value value = slot.value.load(std::memory_order_relaxed);
+    while (!slot.value.compare_exchange_weak(value, value + addend, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Erased keys are left out of Drain and ignore later additions. Erasing an absent key does
+  // nothing and takes no slot
+  void Erase(const Key &key) {
+    if (Slot *slot = FindSlot(key, false)) {
+      slot->state.store(ERASED, std::memory_order_release);
+    }
+  }
+
+  // Keys with their values in no particular order. Must not race with additions
+  template<typename ExecutionPolicy>
+  std::vector<std::pair<Key, Value>> Drain(ExecutionPolicy &&policy) const {
+    TRACE_SCOPE("ConcurrentHashMap drain");
+    const size_t chunk_count = (slots_.size() + CONCURRENT_HASH_MAP_DRAIN_CHUNK_SIZE - 1) / CONCURRENT_HASH_MAP_DRAIN_CHUNK_SIZE;
+    std::vector<size_t> chunk_offsets(chunk_count + 1);
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    // Each chunk is counted, then written at its offset
+    std::for_each(policy, chunks.begin(), chunks.end(), [this, &chunk_offsets](size_t chunk) {
+      const auto [begin, end] = GetChunkSlots(chunk);
+      chunk_offsets[chunk + 1] = std::count_if(begin, end, [](const Slot &slot) {
+        return slot.state.load(std::memory_order_acquire) == READY;
+      });
+    });
+    std::partial_sum(chunk_offsets.begin(), chunk_offsets.end(), chunk_offsets.begin());
+    std::vector<std::pair<Key, Value>> entries(chunk_offsets.back());
+    std::for_each(policy, chunks.begin(), chunks.end(), [this, &chunk_offsets, &entries](size_t chunk) {
+      const auto [begin, end] = GetChunkSlots(chunk);
+      size_t index = chunk_offsets[chunk];
+      for (auto it = begin; it != end; ++it) {
+        if (it->state.load(std::memory_order_acquire) == READY) {
+          entries[index++] = {it->key, it->value.load(std::memory_order_relaxed)};
+        }
+      }
+    });
+    return entries;
+  }
+
+  size_t GetCapacity() const {
+    return slots_.size();
+  }
+
+ private:
+  enum SlotState : uint8_t {
+    EMPTY,
+    // Claimed, key is being written
+    CLAIMED,
+    READY,
+    ERASED,
+  };
+
+  struct Slot {
+    std::atomic<uint8_t> state{EMPTY};
+    Key key{};
+    std::atomic<Value> value{0};
+  };
+
+  std::vector<Slot> slots_;
+  size_t slot_mask_;
+
+  static size_t GetSlotCount(size_t max_key_count) {
+    size_t slot_count = 2;
+    while (slot_count < max_key_count * 2) {
+      slot_count *= 2;
+    }
+    return slot_count;
+  }
+
+  // Claims an empty slot for an absent key if is_claiming, otherwise returns nullptr for it
+  Slot *FindSlot(const Key &key, bool is_claiming) {
+    // std::hash of an integer is the integer itself
+    const uint64_t hash = MixHash(static_cast<uint64_t>(Hash{}(key)));
+    for (size_t probe = 0; probe < slots_.size(); ++probe) {
+      Slot &slot = slots_[(hash + probe) & slot_mask_];
+      uint8_t state = slot.state.load(std::memory_order_acquire);
+      if (state == EMPTY) {
+        if (!is_claiming) {
+          return nullptr;
+        }
+        if (slot.state.compare_exchange_strong(state, CLAIMED, std::memory_order_acquire)) {
+          slot.key = key;
+          slot.state.store(READY, std::memory_order_release);
+          return &slot;
+        }
+      }
+      // Another thread is publishing the key of this slot, it only has a store left
+      while (state == CLAIMED) {
+        state = slot.state.load(std::memory_order_acquire);
+      }
+      if (slot.key == key) {
+        return &slot;
+      }
+    }
+    if (!is_claiming) {
+      return nullptr;
+    }
+    throw std::length_error("ConcurrentHashMap is full"s);
+  }
+
+  std::pair<typename std::vector<Slot>::const_iterator, typename std::vector<Slot>::const_iterator>
+  GetChunkSlots(size_t chunk) const {
+    const size_t begin = chunk * CONCURRENT_HASH_MAP_DRAIN_CHUNK_SIZE;
+    const size_t end = std::min(begin + CONCURRENT_HASH_MAP_DRAIN_CHUNK_SIZE, slots_.size());
+    return {slots_.begin() + begin, slots_.begin() + end};
+  }
+};
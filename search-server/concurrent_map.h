@@ -1,6 +1,10 @@
 #pragma once
 
+#include "hash.h"
+#include "trace.h"
+
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <future>
 #include <map>
@@ -10,6 +14,18 @@
 #include <vector>
 #include <mutex>
 
+// Buckets per thread that keep threads mostly out of each other's buckets
+const size_t CONCURRENT_MAP_BUCKETS_PER_THREAD = 16;
+
+const size_t MAX_CONCURRENT_MAP_BUCKET_COUNT = 1024;
+
+struct BucketContention {
+  uint64_t acquire_count = 0;
+  // Acquisitions that found the bucket locked by another thread
+  uint64_t contended_count = 0;
+  std::chrono::nanoseconds wait_time{};
+};
+
 template<typename Key, typename Value>
 class ConcurrentMap {
  public:
@@ -21,38 +37,85 @@ class ConcurrentMap {
   };
 
   explicit ConcurrentMap(size_t bucket_count)
-      : bucket_count_(bucket_count), buckets_(bucket_count) {};
+      : bucket_count_(std::max<size_t>(bucket_count, 1)), buckets_(bucket_count_) {};
+
+  // Enough buckets for the threads to rarely meet, but not more than there are keys
+  static size_t ChooseBucketCount(size_t expected_key_count, size_t thread_count) {
+    const size_t bucket_count = std::max<size_t>(thread_count, 1) * CONCURRENT_MAP_BUCKETS_PER_THREAD;
+    return std::clamp<size_t>(std::min(bucket_count, expected_key_count), 1, MAX_CONCURRENT_MAP_BUCKET_COUNT);
+  }
+
+  // Counts acquisitions, contended ones and the time spent waiting, per bucket. Enable
+  // before the map is shared
+  void EnableContentionStats() {
+    has_contention_stats_ = true;
+  }
 
   Access operator[](const Key &key) {
     auto &bucket = GetBucket(key);
-    return {std::lock_guard(bucket.mutex_), bucket.values_[key]};
+    Lock(bucket);
+    return {std::lock_guard(bucket.mutex_, std::adopt_lock), bucket.values_[key]};
   };
 
   std::map<Key, Value> BuildOrdinaryMap() {
+    TRACE_SCOPE("ConcurrentMap merge");
     std::map<Key, Value> ordinary_map;
-    for (auto &[mutex_, values_] : buckets_) {
-      std::lock_guard guard(mutex_);
-      ordinary_map.merge(values_);
+    for (auto &bucket : buckets_) {
+      std::lock_guard guard(bucket.mutex_);
+      ordinary_map.merge(bucket.values_);
     }
     return ordinary_map;
   };
 
   void erase(const Key &key) {
     auto &bucket = GetBucket(key);
-    std::lock_guard guard(bucket.mutex_);
+    Lock(bucket);
+    std::lock_guard guard(bucket.mutex_, std::adopt_lock);
     bucket.values_.erase(key);
   }
 
+  // Empty unless contention stats are enabled
+  std::vector<BucketContention> GetContentionStats() const {
+    std::vector<BucketContention> stats;
+    if (has_contention_stats_) {
+      stats.reserve(buckets_.size());
+      for (const auto &bucket : buckets_) {
+        std::lock_guard guard(bucket.mutex_);
+        stats.push_back(bucket.contention_);
+      }
+    }
+    return stats;
+  }
+
  private:
   struct Bucket {
-    std::mutex mutex_;
+    mutable std::mutex mutex_;
     std::map<Key, Value> values_;
+    BucketContention contention_;
   };
 
   size_t bucket_count_;
   std::vector<Bucket> buckets_;
+  bool has_contention_stats_ = false;
 
   Bucket &GetBucket(const Key &key) {
-    return buckets_[static_cast<uint64_t>(key) % bucket_count_];
+    return buckets_[MixHash(static_cast<uint64_t>(key)) % bucket_count_];
+  }
+
+  void Lock(Bucket &bucket) {
+    if (!has_contention_stats_) {
+      bucket.mutex_.lock();
+      return;
+    }
+    // Counters are updated under the bucket lock
+    if (bucket.mutex_.try_lock()) {
+      ++bucket.contention_.acquire_count;
+      return;
+    }
+    const auto wait_start = std::chrono::steady_clock::now();
+    bucket.mutex_.lock();
+    ++bucket.contention_.acquire_count;
+    ++bucket.contention_.contended_count;
+    bucket.contention_.wait_time += std::chrono::steady_clock::now() - wait_start;
   }
 };
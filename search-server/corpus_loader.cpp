@@ -0,0 +1,339 @@
+#include "corpus_loader.h"
+#include "bounded_queue.h"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+// Enough to keep every tokenizer busy while bounding the documents in flight
+const size_t QUEUE_CAPACITY_PER_TOKENIZER = 64;
+
+class MappedFile {
+ public:
+  explicit MappedFile(const string &path);
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile();
+
+  string_view GetData() const;
+
+ private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+MappedFile::MappedFile(const string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw runtime_error("Can't open corpus file "s + path);
+  }
+  struct stat file_stat{};
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    throw runtime_error("Can't stat corpus file "s + path);
+  }
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data_ == MAP_FAILED) {
+      close(fd);
+      throw runtime_error("Can't map corpus file "s + path);
+    }
+    madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+string_view MappedFile::GetData() const {
+  return {static_cast<const char *>(data_), size_};
+}
+
+// Keeps the parser at most capacity documents ahead of the next one to insert. A tokenizer
+// stuck on an early document would otherwise let the reorder buffer take the whole file
+class SequenceWindow {
+ public:
+  explicit SequenceWindow(size_t capacity);
+
+  // Blocks while sequence is capacity or more documents ahead, returns false once closed
+  bool WaitFor(size_t sequence);
+
+  void Advance(size_t next_sequence);
+
+  void Close();
+
+ private:
+  mutex mutex_;
+  condition_variable state_changed_;
+  size_t capacity_;
+  size_t next_sequence_ = 0;
+  bool is_closed_ = false;
+};
+
+SequenceWindow::SequenceWindow(size_t capacity) : capacity_(capacity) {
+}
+
+bool SequenceWindow::WaitFor(size_t sequence) {
+  unique_lock lock(mutex_);
+  state_changed_.wait(lock, [this, sequence] { return is_closed_ || sequence - next_sequence_ < capacity_; });
+  return !is_closed_;
+}
+
+void SequenceWindow::Advance(size_t next_sequence) {
+  {
+    lock_guard guard(mutex_);
+    next_sequence_ = next_sequence;
+  }
+  state_changed_.notify_all();
+}
+
+void SequenceWindow::Close() {
+  {
+    lock_guard guard(mutex_);
+    is_closed_ = true;
+  }
+  state_changed_.notify_all();
+}
+
+struct ParsedItem {
+  size_t sequence;
+  CorpusLine line;
+  exception_ptr error;
+};
+
+struct TokenizedItem {
+  size_t sequence;
+  CorpusLine line;
+  TokenizedDocument document;
+  exception_ptr error;
+};
+
+double GetSeconds(Clock::duration duration) {
+  return chrono::duration<double>(duration).count();
+}
+
+int ParseInt(string_view text) {
+  int value = 0;
+  const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+  if (error != errc{} || end != text.data() + text.size()) {
+    throw invalid_argument("Invalid number in corpus line: "s + string(text));
+  }
+  return value;
+}
+
+DocumentStatus ParseStatus(string_view text) {
+  static const map<string_view, DocumentStatus> statuses = {
+      {"ACTUAL"sv, DocumentStatus::ACTUAL},
+      {"IRRELEVANT"sv, DocumentStatus::IRRELEVANT},
+      {"BANNED"sv, DocumentStatus::BANNED},
+      {"REMOVED"sv, DocumentStatus::REMOVED},
+  };
+  const auto it = statuses.find(text);
+  if (it == statuses.end()) {
+    throw invalid_argument("Invalid status in corpus line: "s + string(text));
+  }
+  return it->second;
+}
+
+}  // namespace
+
+CorpusLine ParseCorpusLine(string_view line) {
+  string_view fields[3];
+  for (string_view &field : fields) {
+    const size_t tab_pos = line.find('\t');
+    if (tab_pos == string_view::npos) {
+      throw invalid_argument("Corpus line must have four tab separated fields"s);
+    }
+    field = line.substr(0, tab_pos);
+    line.remove_prefix(tab_pos + 1);
+  }
+  CorpusLine corpus_line;
+  corpus_line.id = ParseInt(fields[0]);
+  corpus_line.status = ParseStatus(fields[1]);
+  for (const string_view rating : SplitIntoWords(fields[2])) {
+    corpus_line.ratings.push_back(ParseInt(rating));
+  }
+  corpus_line.text = line;
+  return corpus_line;
+}
+
+ostream &operator<<(ostream &os, const IngestReport &report) {
+  os << "ingest: "s << report.document_count << " documents, "s << report.byte_count
+     << " bytes in "s << report.wall_seconds * 1000 << " ms"s << endl;
+  for (const IngestStageStats &stage : report.stages) {
+    os << "  "s << stage.name << ": "s << stage.busy_seconds * 1000 << " ms busy, "s;
+    if (stage.busy_seconds > 0) {
+      os << stage.document_count / stage.busy_seconds << " documents/s"s;
+    } else {
+      os << stage.document_count << " documents"s;
+    }
+    os << endl;
+  }
+  return os;
+}
+
+IngestReport LoadCorpus(SearchServer &search_server, const string &path, size_t tokenizer_count) {
+  const auto start_time = Clock::now();
+  tokenizer_count = max<size_t>(tokenizer_count, 1);
+  const MappedFile file(path);
+  const string_view data = file.GetData();
+
+  BoundedQueue<ParsedItem> parsed_queue(QUEUE_CAPACITY_PER_TOKENIZER * tokenizer_count);
+  BoundedQueue<TokenizedItem> tokenized_queue(QUEUE_CAPACITY_PER_TOKENIZER * tokenizer_count);
+  SequenceWindow window(QUEUE_CAPACITY_PER_TOKENIZER * tokenizer_count);
+  IngestStageStats parse_stats{"parse"sv};
+  vector<IngestStageStats> tokenize_stats(tokenizer_count, IngestStageStats{"tokenize"sv});
+  IngestStageStats insert_stats{"insert"sv};
+  atomic<size_t> active_tokenizer_count = tokenizer_count;
+
+  const auto parse = [data, &parsed_queue, &window, &parse_stats] {
+    size_t sequence = 0;
+    for (size_t start = 0; start < data.size();) {
+      if (!window.WaitFor(sequence)) {
+        break;
+      }
+      const auto parse_start = Clock::now();
+      const size_t end = min(data.find('\n', start), data.size());
+      string_view line = data.substr(start, end - start);
+      start = end + 1;
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      if (line.empty()) {
+        continue;
+      }
+      ParsedItem item{sequence++, {}, nullptr};
+      try {
+        item.line = ParseCorpusLine(line);
+      } catch (...) {
+        item.error = current_exception();
+      }
+      const bool is_failed = static_cast<bool>(item.error);
+      parse_stats.busy_seconds += GetSeconds(Clock::now() - parse_start);
+      ++parse_stats.document_count;
+      if (!parsed_queue.Push(move(item)) || is_failed) {
+        break;
+      }
+    }
+    parsed_queue.Close();
+  };
+  const auto tokenize = [&](size_t tokenizer_index) {
+    IngestStageStats &stats = tokenize_stats[tokenizer_index];
+    while (auto parsed_item = parsed_queue.Pop()) {
+      const auto tokenize_start = Clock::now();
+      TokenizedItem item{parsed_item->sequence, move(parsed_item->line), {}, parsed_item->error};
+      if (!item.error) {
+        try {
+          item.document = search_server.TokenizeDocument(item.line.text);
+        } catch (...) {
+          item.error = current_exception();
+        }
+      }
+      stats.busy_seconds += GetSeconds(Clock::now() - tokenize_start);
+      ++stats.document_count;
+      if (!tokenized_queue.Push(move(item))) {
+        break;
+      }
+    }
+    if (--active_tokenizer_count == 0) {
+      tokenized_queue.Close();
+    }
+  };
+
+  vector<thread> threads;
+  threads.reserve(tokenizer_count + 1);
+  const auto stop_pipeline = [&] {
+    parsed_queue.Close();
+    tokenized_queue.Close();
+    window.Close();
+    for (thread &thread : threads) {
+      thread.join();
+    }
+  };
+  try {
+    threads.emplace_back(parse);
+    for (size_t i = 0; i < tokenizer_count; ++i) {
+      threads.emplace_back(tokenize, i);
+    }
+  } catch (...) {
+    // Threads that did start must not be destroyed while joinable
+    stop_pipeline();
+    throw;
+  }
+
+  // Tokenizers finish out of order, documents are added in file order
+  exception_ptr error;
+  map<size_t, TokenizedItem> pending_items;
+  size_t next_sequence = 0;
+  while (!error) {
+    auto item = tokenized_queue.Pop();
+    if (!item) {
+      break;
+    }
+    pending_items.emplace(item->sequence, move(*item));
+    for (auto it = pending_items.find(next_sequence); it != pending_items.end() && !error;
+         it = pending_items.find(next_sequence)) {
+      const auto insert_start = Clock::now();
+      const TokenizedItem &ready_item = it->second;
+      if (ready_item.error) {
+        error = ready_item.error;
+      } else {
+        try {
+          search_server.AddDocument(ready_item.line.id,
+                                    ready_item.document,
+                                    ready_item.line.status,
+                                    ready_item.line.ratings);
+          ++insert_stats.document_count;
+        } catch (...) {
+          error = current_exception();
+        }
+      }
+      insert_stats.busy_seconds += GetSeconds(Clock::now() - insert_start);
+      pending_items.erase(it);
+      window.Advance(++next_sequence);
+    }
+  }
+  stop_pipeline();
+  if (error) {
+    rethrow_exception(error);
+  }
+
+  IngestReport report;
+  report.document_count = insert_stats.document_count;
+  report.byte_count = data.size();
+  report.stages.push_back(parse_stats);
+  IngestStageStats total_tokenize_stats{"tokenize"sv};
+  for (const IngestStageStats &stats : tokenize_stats) {
+    total_tokenize_stats.document_count += stats.document_count;
+    // Tokenizers run in parallel, the stage is as busy as its average worker
+    total_tokenize_stats.busy_seconds += stats.busy_seconds / tokenizer_count;
+  }
+  report.stages.push_back(total_tokenize_stats);
+  report.stages.push_back(insert_stats);
+  report.wall_seconds = GetSeconds(Clock::now() - start_time);
+  return report;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct IngestStageStats {
+  std::string_view name;
+  size_t document_count = 0;
+  // Time spent working, waits on the neighbouring queues are excluded
+  double busy_seconds = 0;
+};
+
+struct IngestReport {
+  size_t document_count = 0;
+  size_t byte_count = 0;
+  double wall_seconds = 0;
+  std::vector<IngestStageStats> stages;
+};
+
+std::ostream &operator<<(std::ostream &os, const IngestReport &report);
+
+// Parses "<id>\t<status>\t<space separated ratings>\t<text>", status is ACTUAL, IRRELEVANT,
+// BANNED or REMOVED. Text is a view into line
+struct CorpusLine {
+  int id = 0;
+  DocumentStatus status = DocumentStatus::ACTUAL;
+  std::vector<int> ratings;
+  std::string_view text;
+};
+
+CorpusLine ParseCorpusLine(std::string_view line);
+
+// Memory-maps the corpus file, one document per line, and indexes it through a pipeline:
+// parse, tokenize on tokenizer_count threads, then AddDocument in file order.
+// Stages are connected by bounded queues, document texts are never copied.
+// Throws the first parse or AddDocument error after the documents before it are indexed
+IngestReport LoadCorpus(SearchServer &search_server,
+                        const std::string &path,
+                        size_t tokenizer_count = std::thread::hardware_concurrency());
@@ -19,4 +19,6 @@ enum class DocumentStatus {
   REMOVED,
 };
 
+const int DOCUMENT_STATUS_COUNT = 4;
+
 std::ostream &operator<<(std::ostream &os, const Document &document);
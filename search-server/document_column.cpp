@@ -0,0 +1,50 @@
+#include "document_column.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void DocumentColumn::Insert(int document_id, int value) {
+  ++value_count_;
+  const size_t index = document_id;
+  if (index >= dense_values_.size() && index < max(MIN_DENSE_SIZE, value_count_ * MAX_DENSE_SPARSITY)) {
+    // Grow geometrically and take over the sparse ids the dense part now covers
+    const size_t dense_size = max(index + 1, min(dense_values_.size() * 2, value_count_ * MAX_DENSE_SPARSITY));
+    dense_values_.resize(dense_size);
+    for (auto it = sparse_values_.begin(); it != sparse_values_.end();) {
+      if (static_cast<size_t>(it->first) < dense_size) {
+        dense_values_[it->first] = it->second;
+        it = sparse_values_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  if (index < dense_values_.size()) {
+    dense_values_[index] = value;
+  } else {
+    sparse_values_[document_id] = value;
+  }
+}
+
+void DocumentColumn::Erase(int document_id) {
+  --value_count_;
+  if (static_cast<size_t>(document_id) < dense_values_.size()) {
+    dense_values_[document_id] = 0;
+  } else {
+    sparse_values_.erase(document_id);
+  }
+}
+
+const vector<int> &DocumentColumn::GetDenseValues() const {
+  return dense_values_;
+}
+
+const unordered_map<int, int> &DocumentColumn::GetSparseValues() const {
+  return sparse_values_;
+}
+
+int DocumentColumn::GetSparse(int document_id) const {
+  const auto it = sparse_values_.find(document_id);
+  return it == sparse_values_.end() ? 0 : it->second;
+}
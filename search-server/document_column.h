@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// Integer column keyed by document id, absent ids read as zero. Ids are stored in a vector
+// while it stays at least 1 / MAX_DENSE_SPARSITY full, ids beyond that go to a hash map, so
+// one huge id does not allocate a slot for every smaller one
+class DocumentColumn {
+ public:
+  // Dense part is allowed to grow to this size however few ids it holds
+  static constexpr size_t MIN_DENSE_SIZE = 1024;
+  static constexpr size_t MAX_DENSE_SPARSITY = 4;
+
+  int Get(int document_id) const {
+    if (static_cast<size_t>(document_id) < dense_values_.size()) {
+      return dense_values_[document_id];
+    }
+    return GetSparse(document_id);
+  }
+
+  // The id must not be in the column yet
+  void Insert(int document_id, int value);
+
+  void Erase(int document_id);
+
+  // Values of ids [0, dense size)
+  const std::vector<int> &GetDenseValues() const;
+
+  // Values of the ids at or beyond the dense size
+  const std::unordered_map<int, int> &GetSparseValues() const;
+
+ private:
+  std::vector<int> dense_values_;
+  std::unordered_map<int, int> sparse_values_;
+  size_t value_count_ = 0;
+
+  int GetSparse(int document_id) const;
+};
@@ -0,0 +1,133 @@
+#include "filter_expression.h"
+
+#include <algorithm>
+
+using namespace std;
+
+FilterExpression::FilterExpression(Kind kind) : kind_(kind) {
+}
+
+FilterExpression FilterExpression::StatusIn(initializer_list<DocumentStatus> statuses) {
+  FilterExpression expression(Kind::STATUS_IN);
+  for (const DocumentStatus status : statuses) {
+    expression.status_mask_ |= 1u << static_cast<int>(status);
+  }
+  return expression;
+}
+
+FilterExpression FilterExpression::RatingBetween(int low, int high) {
+  FilterExpression expression(Kind::RATING_BETWEEN);
+  expression.low_ = low;
+  expression.high_ = high;
+  return expression;
+}
+
+FilterExpression FilterExpression::IdBetween(int low, int high) {
+  FilterExpression expression(Kind::ID_BETWEEN);
+  expression.low_ = max(low, 0);
+  expression.high_ = high;
+  return expression;
+}
+
+FilterExpression operator&&(FilterExpression lhs, FilterExpression rhs) {
+  FilterExpression expression(FilterExpression::Kind::AND);
+  expression.operands_.push_back(move(lhs));
+  expression.operands_.push_back(move(rhs));
+  return expression;
+}
+
+FilterExpression operator||(FilterExpression lhs, FilterExpression rhs) {
+  FilterExpression expression(FilterExpression::Kind::OR);
+  expression.operands_.push_back(move(lhs));
+  expression.operands_.push_back(move(rhs));
+  return expression;
+}
+
+FilterExpression operator!(FilterExpression operand) {
+  FilterExpression expression(FilterExpression::Kind::NOT);
+  expression.operands_.push_back(move(operand));
+  return expression;
+}
+
+Bitmap FilterExpression::Evaluate(const DocumentColumns &columns) const {
+  switch (kind_) {
+    case Kind::STATUS_IN: {
+      Bitmap result;
+      for (int status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        if (status_mask_ >> status & 1u) {
+          result |= columns.status_to_documents[status];
+        }
+      }
+      return result;
+    }
+    case Kind::RATING_BETWEEN: {
+      Bitmap result = ScanRatings(columns.ratings, low_, high_);
+      // Rating column has zeros for ids that are not in the index
+      result &= GetAllDocuments(columns);
+      return result;
+    }
+    case Kind::ID_BETWEEN: {
+      if (high_ < 0) {
+        return {};
+      }
+      Bitmap result = GetAllDocuments(columns);
+      result.Crop(low_, static_cast<size_t>(high_) + 1);
+      return result;
+    }
+    case Kind::AND: {
+      Bitmap result = operands_[0].Evaluate(columns);
+      result &= operands_[1].Evaluate(columns);
+      return result;
+    }
+    case Kind::OR: {
+      Bitmap result = operands_[0].Evaluate(columns);
+      result |= operands_[1].Evaluate(columns);
+      return result;
+    }
+    case Kind::NOT: {
+      Bitmap result = GetAllDocuments(columns);
+      result.Subtract(operands_[0].Evaluate(columns));
+      return result;
+    }
+  }
+  return {};
+}
+
+Bitmap FilterExpression::GetAllDocuments(const DocumentColumns &columns) {
+  Bitmap result;
+  for (const Bitmap &documents : columns.status_to_documents) {
+    result |= documents;
+  }
+  return result;
+}
+
+Bitmap FilterExpression::ScanRatings(const DocumentColumn &ratings, int low, int high) {
+  Bitmap result;
+  if (low > high) {
+    return result;
+  }
+  // Branch-free range check over blocks of 64 ratings, the inner loop is auto-vectorized
+  const vector<int> &dense_ratings = ratings.GetDenseValues();
+  const auto width = static_cast<unsigned>(high) - static_cast<unsigned>(low);
+  const size_t full_words = dense_ratings.size() / Bitmap::WORD_BITS;
+  for (size_t word_index = 0; word_index < full_words; ++word_index) {
+    const int *block = dense_ratings.data() + word_index * Bitmap::WORD_BITS;
+    uint64_t word = 0;
+    for (size_t bit = 0; bit < Bitmap::WORD_BITS; ++bit) {
+      const auto offset = static_cast<unsigned>(block[bit]) - static_cast<unsigned>(low);
+      word |= static_cast<uint64_t>(offset <= width) << bit;
+    }
+    result.SetWord(word_index, word);
+  }
+  for (size_t id = full_words * Bitmap::WORD_BITS; id < dense_ratings.size(); ++id) {
+    if (dense_ratings[id] >= low && dense_ratings[id] <= high) {
+      result.Set(id);
+    }
+  }
+  for (const auto [id, rating] : ratings.GetSparseValues()) {
+    if (rating >= low && rating <= high) {
+      result.Set(id);
+    }
+  }
+  return result;
+}
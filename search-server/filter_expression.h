@@ -0,0 +1,56 @@
+#pragma once
+
+#include "bitmap.h"
+#include "document.h"
+#include "document_column.h"
+
+#include <initializer_list>
+#include <vector>
+
+// Read-only view of the per-document columns a filter is evaluated against
+struct DocumentColumns {
+  const std::vector<Bitmap> &status_to_documents;
+  const DocumentColumn &ratings;
+};
+
+// Declarative document filter. Unlike a predicate lambda it is evaluated once per query
+// into a candidate bitmap by scanning the status and rating columns
+class FilterExpression {
+ public:
+  static FilterExpression StatusIn(std::initializer_list<DocumentStatus> statuses);
+
+  // Both bounds are inclusive
+  static FilterExpression RatingBetween(int low, int high);
+
+  static FilterExpression IdBetween(int low, int high);
+
+  Bitmap Evaluate(const DocumentColumns &columns) const;
+
+  friend FilterExpression operator&&(FilterExpression lhs, FilterExpression rhs);
+
+  friend FilterExpression operator||(FilterExpression lhs, FilterExpression rhs);
+
+  friend FilterExpression operator!(FilterExpression operand);
+
+ private:
+  enum class Kind {
+    STATUS_IN,
+    RATING_BETWEEN,
+    ID_BETWEEN,
+    AND,
+    OR,
+    NOT,
+  };
+
+  Kind kind_;
+  unsigned status_mask_ = 0;
+  int low_ = 0;
+  int high_ = 0;
+  std::vector<FilterExpression> operands_;
+
+  explicit FilterExpression(Kind kind);
+
+  static Bitmap GetAllDocuments(const DocumentColumns &columns);
+
+  static Bitmap ScanRatings(const DocumentColumn &ratings, int low, int high);
+};
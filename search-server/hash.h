@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Murmur3 finalizer. Every input bit affects every output bit, so keys differing only in low
+// bits, like neighbouring document ids, land in unrelated slots and buckets
+inline uint64_t MixHash(uint64_t hash) {
+  hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdu;
+  hash = (hash ^ (hash >> 33)) * 0xc4ceb9fe1a85ec53u;
+  return hash ^ (hash >> 33);
+}
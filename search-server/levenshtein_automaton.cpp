@@ -0,0 +1,40 @@
+#include "levenshtein_automaton.h"
+
+#include <algorithm>
+
+using namespace std;
+
+LevenshteinAutomaton::LevenshteinAutomaton(string_view pattern, int max_distance)
+    : pattern_(pattern), max_distance_(max_distance) {
+}
+
+LevenshteinAutomaton::State LevenshteinAutomaton::Start() const {
+  State state(pattern_.size() + 1);
+  for (size_t i = 0; i < state.size(); ++i) {
+    state[i] = min(static_cast<int>(i), max_distance_ + 1);
+  }
+  return state;
+}
+
+LevenshteinAutomaton::State LevenshteinAutomaton::Step(const State &state, char c) const {
+  State next(state.size());
+  next[0] = min(state[0] + 1, max_distance_ + 1);
+  for (size_t i = 1; i < state.size(); ++i) {
+    const int substitution = state[i - 1] + (pattern_[i - 1] == c ? 0 : 1);
+    // Distances above max_distance are all equivalent, capping keeps states small
+    next[i] = min({substitution, state[i] + 1, next[i - 1] + 1, max_distance_ + 1});
+  }
+  return next;
+}
+
+bool LevenshteinAutomaton::IsMatch(const State &state) const {
+  return state.back() <= max_distance_;
+}
+
+bool LevenshteinAutomaton::CanMatch(const State &state) const {
+  return *min_element(state.begin(), state.end()) <= max_distance_;
+}
+
+int LevenshteinAutomaton::GetDistance(const State &state) const {
+  return state.back();
+}
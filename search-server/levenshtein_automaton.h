@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Accepts words within max_distance edits (insertion, deletion, substitution) of a pattern.
+// State is the row of the edit distance matrix for the consumed prefix
+class LevenshteinAutomaton {
+ public:
+  using State = std::vector<int>;
+
+  LevenshteinAutomaton(std::string_view pattern, int max_distance);
+
+  State Start() const;
+
+  State Step(const State &state, char c) const;
+
+  bool IsMatch(const State &state) const;
+
+  // False when no continuation of the consumed prefix can be accepted
+  bool CanMatch(const State &state) const;
+
+  int GetDistance(const State &state) const;
+
+ private:
+  std::string_view pattern_;
+  int max_distance_;
+};
+
+// Calls callback(item, distance) for items of a map ordered by string keys whose key is
+// within max_distance of pattern, stopping after max_count items. Subtrees of keys sharing a
+// prefix that can't be accepted are skipped with one lower_bound, so the whole map is not scanned
+template<typename SortedMap, typename Callback>
+void ForEachKeyWithinDistance(const SortedMap &items,
+                              std::string_view pattern,
+                              int max_distance,
+                              size_t max_count,
+                              Callback callback);
+
+template<typename SortedMap, typename Callback>
+void ForEachKeyWithinDistance(const SortedMap &items,
+                              std::string_view pattern,
+                              int max_distance,
+                              size_t max_count,
+                              Callback callback) {
+  const LevenshteinAutomaton automaton(pattern, max_distance);
+  // states[i] is the state after the first i characters of previous
+  std::vector<LevenshteinAutomaton::State> states{automaton.Start()};
+  std::string_view previous;
+  size_t count = 0;
+  auto it = items.begin();
+  while (it != items.end() && count < max_count) {
+    const std::string_view key = it->first;
+    size_t common_size = 0;
+    while (common_size < previous.size() && common_size < key.size()
+        && previous[common_size] == key[common_size]) {
+      ++common_size;
+    }
+    states.resize(common_size + 1);
+    bool is_dead = false;
+    for (size_t i = common_size; i < key.size() && !is_dead; ++i) {
+      states.push_back(automaton.Step(states.back(), key[i]));
+      is_dead = !automaton.CanMatch(states.back());
+    }
+    previous = key.substr(0, states.size() - 1);
+    if (!is_dead) {
+      if (automaton.IsMatch(states.back())) {
+        callback(*it, automaton.GetDistance(states.back()));
+        ++count;
+      }
+      ++it;
+      continue;
+    }
+    // Seek to the first key that doesn't start with the dead prefix
+    std::string next_key(previous);
+    while (!next_key.empty() && static_cast<unsigned char>(next_key.back()) == 0xff) {
+      next_key.pop_back();
+    }
+    if (next_key.empty()) {
+      break;
+    }
+    next_key.back() = static_cast<char>(static_cast<unsigned char>(next_key.back()) + 1);
+    it = items.lower_bound(next_key);
+  }
+}
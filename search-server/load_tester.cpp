@@ -0,0 +1,152 @@
+#include "load_tester.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+LatencyPercentiles ComputePercentiles(vector<chrono::nanoseconds> &latencies) {
+  LatencyPercentiles percentiles;
+  if (latencies.empty()) {
+    return percentiles;
+  }
+  // Nearest rank, each nth_element only reorders the tail left after the previous one
+  const auto at_rank = [&latencies](double quantile, size_t from) {
+    const size_t rank = min(static_cast<size_t>(quantile * latencies.size()), latencies.size() - 1);
+    nth_element(latencies.begin() + from, latencies.begin() + rank, latencies.end());
+    return pair{latencies[rank], rank};
+  };
+  const auto [p50, p50_rank] = at_rank(0.5, 0);
+  const auto [p99, p99_rank] = at_rank(0.99, p50_rank);
+  const auto [p999, p999_rank] = at_rank(0.999, p99_rank);
+  percentiles.p50 = p50;
+  percentiles.p99 = p99;
+  percentiles.p999 = p999;
+  percentiles.max = *max_element(latencies.begin() + p999_rank, latencies.end());
+  return percentiles;
+}
+
+ostream &operator<<(ostream &os, const LatencyPercentiles &percentiles) {
+  const auto to_us = [](chrono::nanoseconds latency) {
+    return chrono::duration_cast<chrono::microseconds>(latency).count();
+  };
+  return os << "p50 "s << to_us(percentiles.p50) << " us, p99 "s << to_us(percentiles.p99)
+            << " us, p999 "s << to_us(percentiles.p999) << " us, max "s << to_us(percentiles.max) << " us"s;
+}
+
+}  // namespace
+
+ostream &operator<<(ostream &os, const LoadTestReport &report) {
+  os << (report.mode == LoadMode::CLOSED_LOOP ? "closed loop: "s : "open loop: "s)
+     << report.served_count << " served, "s << report.rejected_count << " rejected, "s
+     << report.error_count << " failed in "s << report.wall_seconds * 1000 << " ms, "s
+     << report.throughput << " queries/s, "s << report.empty_result_rate * 100 << "% empty"s << endl;
+  os << "  latency: "s << report.latency << endl;
+  if (report.mode == LoadMode::OPEN_LOOP) {
+    os << "  uncorrected latency: "s << report.uncorrected_latency << endl;
+  }
+  return os;
+}
+
+vector<string> ReadQueryLog(const string &path) {
+  ifstream in(path);
+  if (!in) {
+    throw invalid_argument("Cannot open query log "s + path);
+  }
+  vector<string> queries;
+  for (string line; getline(in, line);) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (!line.empty()) {
+      queries.push_back(move(line));
+    }
+  }
+  return queries;
+}
+
+LoadTestReport RunLoadTest(const SearchServer &search_server,
+                           const vector<string> &queries,
+                           const LoadTestOptions &options) {
+  if (queries.empty()) {
+    throw invalid_argument("Load test needs at least one query"s);
+  }
+  if (options.client_count == 0) {
+    throw invalid_argument("Load test needs at least one client"s);
+  }
+  if (options.mode == LoadMode::OPEN_LOOP && !(options.arrival_rate > 0)) {
+    throw invalid_argument("Arrival rate must be positive"s);
+  }
+
+  RequestQueue request_queue(search_server, options.admission);
+  const chrono::duration<double> arrival_interval(1 / options.arrival_rate);
+  atomic<size_t> next_request = 0;
+  atomic<size_t> rejected_count = 0;
+  atomic<size_t> error_count = 0;
+  // Per client, merged once the clients are done
+  vector<vector<chrono::nanoseconds>> client_latencies(options.client_count);
+  vector<vector<chrono::nanoseconds>> client_uncorrected_latencies(options.client_count);
+
+  const auto start_time = Clock::now();
+  const auto run_client = [&](size_t client) {
+    for (size_t request = next_request++; request < options.request_count; request = next_request++) {
+      Clock::time_point scheduled_time = Clock::now();
+      if (options.mode == LoadMode::OPEN_LOOP) {
+        scheduled_time = start_time + chrono::duration_cast<Clock::duration>(arrival_interval * request);
+        this_thread::sleep_until(scheduled_time);
+      }
+      const auto send_time = Clock::now();
+      try {
+        if (request_queue.SubmitFindRequest(queries[request % queries.size()], options.status).is_rejected) {
+          ++rejected_count;
+          continue;
+        }
+      } catch (const exception &) {
+        ++error_count;
+        continue;
+      }
+      const auto finish_time = Clock::now();
+      client_latencies[client].push_back(finish_time - scheduled_time);
+      if (options.mode == LoadMode::OPEN_LOOP) {
+        client_uncorrected_latencies[client].push_back(finish_time - send_time);
+      }
+    }
+  };
+  vector<thread> clients;
+  for (size_t client = 0; client < options.client_count; ++client) {
+    clients.emplace_back(run_client, client);
+  }
+  for (thread &client : clients) {
+    client.join();
+  }
+
+  LoadTestReport report;
+  report.mode = options.mode;
+  report.wall_seconds = chrono::duration<double>(Clock::now() - start_time).count();
+  report.rejected_count = rejected_count;
+  report.error_count = error_count;
+  const auto merge = [](vector<vector<chrono::nanoseconds>> &parts) {
+    vector<chrono::nanoseconds> merged;
+    for (auto &part : parts) {
+      merged.insert(merged.end(), part.begin(), part.end());
+    }
+    return merged;
+  };
+  vector<chrono::nanoseconds> latencies = merge(client_latencies);
+  vector<chrono::nanoseconds> uncorrected_latencies = merge(client_uncorrected_latencies);
+  report.served_count = latencies.size();
+  report.throughput = report.wall_seconds > 0 ? report.served_count / report.wall_seconds : 0;
+  report.latency = ComputePercentiles(latencies);
+  report.uncorrected_latency = ComputePercentiles(uncorrected_latencies);
+  // RequestQueue counts empty results over its window of the most recent requests
+  const size_t window_count = request_queue.GetWindowRequestCount();
+  report.empty_result_rate = window_count > 0 ? request_queue.GetNoResultRequests() * 1.0 / window_count : 0;
+  return report;
+}
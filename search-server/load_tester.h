@@ -0,0 +1,64 @@
+#pragma once
+
+#include "request_queue.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum class LoadMode {
+  // Each client sends its next query once the previous one is answered
+  CLOSED_LOOP,
+  // Queries are sent on a fixed schedule whether or not earlier ones are answered
+  OPEN_LOOP,
+};
+
+struct LoadTestOptions {
+  LoadMode mode = LoadMode::CLOSED_LOOP;
+  // Concurrent clients in closed loop, threads sending the scheduled queries in open loop
+  size_t client_count = 4;
+  // Open loop arrivals per second
+  double arrival_rate = 1000;
+  // Queries sent in total, the log is replayed from its start when it runs out
+  size_t request_count = 10'000;
+  DocumentStatus status = DocumentStatus::ACTUAL;
+  AdmissionOptions admission;
+};
+
+struct LatencyPercentiles {
+  std::chrono::nanoseconds p50{};
+  std::chrono::nanoseconds p99{};
+  std::chrono::nanoseconds p999{};
+  std::chrono::nanoseconds max{};
+};
+
+struct LoadTestReport {
+  LoadMode mode = LoadMode::CLOSED_LOOP;
+  size_t served_count = 0;
+  size_t rejected_count = 0;
+  // Queries the server threw on, such as malformed log lines
+  size_t error_count = 0;
+  double wall_seconds = 0;
+  // Served queries per second
+  double throughput = 0;
+  // In open loop latency runs from the scheduled send time, so queries delayed behind slow
+  // ones count their wait (coordinated omission correction)
+  LatencyPercentiles latency;
+  // Open loop only: latency from the actual send time, what an uncorrected tester reports
+  LatencyPercentiles uncorrected_latency;
+  // Share of empty results among the requests in the RequestQueue window
+  double empty_result_rate = 0;
+};
+
+std::ostream &operator<<(std::ostream &os, const LoadTestReport &report);
+
+// One query per line, empty lines are skipped
+std::vector<std::string> ReadQueryLog(const std::string &path);
+
+// Replays the queries through a RequestQueue over the server, throws invalid_argument if
+// there are no queries, no clients or a non-positive arrival rate
+LoadTestReport RunLoadTest(const SearchServer &search_server,
+                           const std::vector<std::string> &queries,
+                           const LoadTestOptions &options = {});
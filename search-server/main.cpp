@@ -11,5 +11,25 @@ int main() {
   TestRemoveDocument();
   TestMatchDocument2();
   TestFindTopDocuments2();
+  TestFindTopDocumentsByRatingFilter();
+  TestPhraseQueryBenchmark();
+  TestFuzzyQueryBenchmark();
+  TestScoringModelBenchmark();
+  TestLoadCorpusBenchmark();
+  TestPreparedQueryBenchmark();
+  TestSegmentedIndexBenchmark();
+  TestImpactOrderedBenchmark();
+  TestTermFreqFidelityBenchmark();
+  TestQueryDeadlineBenchmark();
+  TestRequestQueueOverloadBenchmark();
+  TestStopWordSetBenchmark();
+  TestTextAnalyzerBenchmark();
+  TestTracerBenchmark();
+  TestConcurrentMapContentionBenchmark();
+  TestConcurrentHashMapScalingBenchmark();
+  TestLoadTesterBenchmark();
+  TestServingIndexSwapBenchmark();
+  TestAutoExecutionBenchmark();
+  TestPartitionedExecutionBenchmark();
   return 0;
 }
@@ -3,6 +3,7 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <optional>
 
 template<typename Iterator>
 class IteratorRange {
@@ -36,12 +37,31 @@ class Paginator {
   std::vector<IteratorRange<Iterator>> pages_;
 };
 
+// Pulls pages on demand: fetch_page(after) returns the page following the item after,
+// or the first page when after is empty
+template<typename Item, typename PageFetcher>
+class LazyPaginator {
+ public:
+  explicit LazyPaginator(PageFetcher fetch_page);
+
+  // Returns an empty page once all pages are pulled
+  std::vector<Item> NextPage();
+
+ private:
+  PageFetcher fetch_page_;
+  std::optional<Item> last_item_;
+  bool is_exhausted_ = false;
+};
+
 template<typename Iterator>
 std::ostream &operator<<(std::ostream &os, const IteratorRange<Iterator> &iteratorRange);
 
 template<typename Container>
 auto Paginate(const Container &c, size_t page_size);
 
+template<typename Item, typename PageFetcher>
+LazyPaginator<Item, PageFetcher> PaginateLazily(PageFetcher fetch_page);
+
 template<typename Iterator>
 IteratorRange<Iterator>::IteratorRange(Iterator range_begin, Iterator range_end)
     : range_begin_(range_begin), range_end_(range_end),
@@ -90,6 +110,25 @@ size_t Paginator<Iterator>::size() const {
   return pages_.size();
 }
 
+template<typename Item, typename PageFetcher>
+LazyPaginator<Item, PageFetcher>::LazyPaginator(PageFetcher fetch_page)
+    : fetch_page_(std::move(fetch_page)) {
+}
+
+template<typename Item, typename PageFetcher>
+std::vector<Item> LazyPaginator<Item, PageFetcher>::NextPage() {
+  if (is_exhausted_) {
+    return {};
+  }
+  std::vector<Item> page = fetch_page_(last_item_);
+  if (page.empty()) {
+    is_exhausted_ = true;
+  } else {
+    last_item_ = page.back();
+  }
+  return page;
+}
+
 template<typename Iterator>
 std::ostream &operator<<(std::ostream &os, const IteratorRange<Iterator> &iteratorRange) {
   for (auto it = iteratorRange.begin(); it != iteratorRange.end(); it = next(it)) {
@@ -102,3 +141,8 @@ template<typename Container>
 auto Paginate(const Container &c, size_t page_size) {
   return Paginator(begin(c), end(c), page_size);
 }
+
+template<typename Item, typename PageFetcher>
+LazyPaginator<Item, PageFetcher> PaginateLazily(PageFetcher fetch_page) {
+  return LazyPaginator<Item, PageFetcher>(std::move(fetch_page));
+}
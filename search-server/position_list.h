@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Increasing word positions of a term in one document, stored as varint-encoded deltas
+class PositionList {
+ public:
+  // Positions must be appended in increasing order
+  void Append(uint32_t position);
+
+  std::vector<uint32_t> Decode() const;
+
+  size_t ByteSize() const;
+
+ private:
+  std::vector<uint8_t> bytes_;
+  uint32_t last_position_ = 0;
+};
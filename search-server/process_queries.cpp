@@ -18,12 +18,31 @@ vector<vector<Document>> ProcessQueries(
       queries.end(),
       result.begin(),
       [&search_server](const auto &query) {
+        TRACE_SCOPE("ProcessQueries query");
         return search_server.FindTopDocuments(query);
       }
   );
   return result;
 }
 
+vector<TopDocuments> ProcessQueries(
+    const SearchServer &search_server,
+    const vector<string> &queries,
+    const QueryDeadline &deadline) {
+  vector<TopDocuments> result(queries.size());
+  transform(
+      execution::par,
+      queries.begin(),
+      queries.end(),
+      result.begin(),
+      [&search_server, &deadline](const auto &query) {
+        TRACE_SCOPE("ProcessQueries query");
+        return search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, {}, deadline);
+      }
+  );
+  return result;
+}
+
 list<Document> ProcessQueriesJoined(
     const SearchServer &search_server,
     const vector<string> &queries) {
@@ -9,6 +9,12 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer &search_server,
     const std::vector<std::string> &queries);
 
+// All queries share the deadline, those it expires before return empty truncated results
+std::vector<TopDocuments> ProcessQueries(
+    const SearchServer &search_server,
+    const std::vector<std::string> &queries,
+    const QueryDeadline &deadline);
+
 std::list<Document> ProcessQueriesJoined(
     const SearchServer &search_server,
     const std::vector<std::string> &queries);
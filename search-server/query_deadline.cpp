@@ -0,0 +1,39 @@
+#include "query_deadline.h"
+
+using namespace std;
+
+CancellationToken::CancellationToken()
+    : is_cancelled_(make_shared<atomic<bool>>(false)) {
+}
+
+void CancellationToken::Cancel() {
+  is_cancelled_->store(true, memory_order_relaxed);
+}
+
+bool CancellationToken::IsCancelled() const {
+  return is_cancelled_->load(memory_order_relaxed);
+}
+
+QueryDeadline::QueryDeadline(Clock::time_point time_limit)
+    : time_limit_(time_limit) {
+}
+
+QueryDeadline::QueryDeadline(Clock::duration timeout)
+    : time_limit_(Clock::now() + timeout) {
+}
+
+QueryDeadline::QueryDeadline(const CancellationToken &token)
+    : is_cancelled_(token.is_cancelled_) {
+}
+
+QueryDeadline::QueryDeadline(Clock::time_point time_limit, const CancellationToken &token)
+    : time_limit_(time_limit), is_cancelled_(token.is_cancelled_) {
+}
+
+bool QueryDeadline::IsExpired() const {
+  if (is_cancelled_ && is_cancelled_->load(memory_order_relaxed)) {
+    return true;
+  }
+  // Unbounded deadline does not read the clock
+  return time_limit_ != Clock::time_point::max() && Clock::now() >= time_limit_;
+}
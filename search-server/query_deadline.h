@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// Traversal loops poll the deadline of a query once per this many postings, a power of two
+const size_t DEADLINE_CHECK_INTERVAL = 1024;
+
+// Flag shared by its copies, cancelling one cancels the queries run under any of them
+class CancellationToken {
+ public:
+  CancellationToken();
+
+  void Cancel();
+
+  bool IsCancelled() const;
+
+ private:
+  friend class QueryDeadline;
+
+  std::shared_ptr<std::atomic<bool>> is_cancelled_;
+};
+
+// Point in time and optional cancellation token after which a query stops scoring and
+// returns what it has found so far, marked as truncated
+class QueryDeadline {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Never expires
+  QueryDeadline() = default;
+
+  explicit QueryDeadline(Clock::time_point time_limit);
+
+  // Expires timeout from now
+  explicit QueryDeadline(Clock::duration timeout);
+
+  explicit QueryDeadline(const CancellationToken &token);
+
+  QueryDeadline(Clock::time_point time_limit, const CancellationToken &token);
+
+  bool IsExpired() const;
+
+ private:
+  Clock::time_point time_limit_ = Clock::time_point::max();
+  std::shared_ptr<const std::atomic<bool>> is_cancelled_;
+};
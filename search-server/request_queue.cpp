@@ -1,8 +1,23 @@
 #include "request_queue.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer &search_server) : search_server_(search_server) {
+// Multiplicative decrease of the concurrency limit after a slow request
+const double CONCURRENCY_DECREASE_FACTOR = 0.9;
+
+RequestQueue::RequestQueue(const SearchServer &search_server, const AdmissionOptions &options)
+    : search_server_(search_server),
+      options_(options),
+      concurrency_limit_(options.initial_concurrency) {
+  if (options.min_concurrency < 1 || options.max_concurrency < options.min_concurrency
+      || options.initial_concurrency < options.min_concurrency
+      || options.initial_concurrency > options.max_concurrency) {
+    throw invalid_argument("Concurrency limits must satisfy 1 <= min <= initial <= max"s);
+  }
+  stats_.concurrency_limit = concurrency_limit_;
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string &raw_query, DocumentStatus status) {
@@ -17,11 +32,83 @@ vector<Document> RequestQueue::AddFindRequest(const string &raw_query) {
   return result;
 }
 
+FindRequestResult RequestQueue::SubmitFindRequest(const string &raw_query,
+                                                  DocumentStatus status,
+                                                  RequestPriority priority) {
+  const auto arrival_time = Clock::now();
+  const int priority_index = static_cast<int>(priority);
+  FindRequestResult result;
+  {
+    unique_lock lock(mutex_);
+    const size_t priority_capacity =
+        priority == RequestPriority::LOW ? options_.queue_capacity / 2 : options_.queue_capacity;
+    const bool can_run_now = waiting_count_ == 0 && running_count_ < static_cast<int>(concurrency_limit_);
+    if (!can_run_now && waiting_count_ >= priority_capacity) {
+      ++stats_.rejected_counts[priority_index];
+      result.is_rejected = true;
+      return result;
+    }
+    const uint64_t ticket = next_ticket_++;
+    deque<uint64_t> &tickets = waiting_tickets_[priority_index];
+    tickets.push_back(ticket);
+    ++waiting_count_;
+    const bool is_admitted = admission_state_changed_.wait_until(lock, arrival_time + options_.max_queue_wait, [&] {
+      return CanRun(ticket);
+    });
+    if (is_admitted) {
+      tickets.pop_front();
+      ++running_count_;
+      ++stats_.admitted_counts[priority_index];
+    } else {
+      tickets.erase(find(tickets.begin(), tickets.end(), ticket));
+      ++stats_.rejected_counts[priority_index];
+      result.is_rejected = true;
+    }
+    --waiting_count_;
+    result.queue_wait = Clock::now() - arrival_time;
+    stats_.total_queue_wait += result.queue_wait;
+    // Another request is at the head of the queue now and may have a free slot
+    admission_state_changed_.notify_all();
+    if (result.is_rejected) {
+      return result;
+    }
+  }
+
+  const auto service_start = Clock::now();
+  try {
+    result.documents = search_server_.FindTopDocuments(raw_query, status);
+  } catch (...) {
+    lock_guard guard(mutex_);
+    OnRequestServed(Clock::now() - service_start);
+    throw;
+  }
+  result.service_time = Clock::now() - service_start;
+  {
+    lock_guard guard(mutex_);
+    OnRequestServed(result.service_time);
+    stats_.total_service_time += result.service_time;
+  }
+  OnNewRequest(result.documents.empty());
+  return result;
+}
+
 int RequestQueue::GetNoResultRequests() const {
+  lock_guard guard(mutex_);
   return noResultsRequestsCount;
 }
 
+size_t RequestQueue::GetWindowRequestCount() const {
+  lock_guard guard(mutex_);
+  return requests_.size();
+}
+
+AdmissionStats RequestQueue::GetAdmissionStats() const {
+  lock_guard guard(mutex_);
+  return stats_;
+}
+
 void RequestQueue::OnNewRequest(bool isResultEmpty) {
+  lock_guard guard(mutex_);
   ++time_count;
   if (!requests_.empty() && time_count - requests_.front().timestamp >= min_in_day_) {
     if (requests_.front().isEmpty) {
@@ -34,3 +121,28 @@ void RequestQueue::OnNewRequest(bool isResultEmpty) {
     ++noResultsRequestsCount;
   }
 }
+
+bool RequestQueue::CanRun(uint64_t ticket) const {
+  if (running_count_ >= static_cast<int>(concurrency_limit_)) {
+    return false;
+  }
+  // Head of the highest priority class that has waiting requests
+  for (const deque<uint64_t> &tickets : waiting_tickets_) {
+    if (!tickets.empty()) {
+      return tickets.front() == ticket;
+    }
+  }
+  return false;
+}
+
+void RequestQueue::OnRequestServed(Clock::duration service_time) {
+  --running_count_;
+  // AIMD: one slot more per window of fast requests, a tenth less after a slow one
+  if (service_time <= options_.target_service_time) {
+    concurrency_limit_ = min<double>(concurrency_limit_ + 1 / concurrency_limit_, options_.max_concurrency);
+  } else {
+    concurrency_limit_ = max<double>(concurrency_limit_ * CONCURRENCY_DECREASE_FACTOR, options_.min_concurrency);
+  }
+  stats_.concurrency_limit = concurrency_limit_;
+  admission_state_changed_.notify_all();
+}
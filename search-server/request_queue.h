@@ -3,13 +3,55 @@
 #include "document.h"
 #include "search_server.h"
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <deque>
 
+// Waiting requests are admitted in priority order, low priority ones are shed first
+enum class RequestPriority {
+  HIGH,
+  NORMAL,
+  LOW,
+};
+
+const int REQUEST_PRIORITY_COUNT = 3;
+
+struct AdmissionOptions {
+  // Requests waiting for a free slot, arrivals beyond it are rejected at once.
+  // Low priority requests are rejected once half of it is taken
+  size_t queue_capacity = 64;
+  // Concurrency limit starts at initial_concurrency and stays in [min_concurrency, max_concurrency]
+  int min_concurrency = 1;
+  int max_concurrency = 64;
+  int initial_concurrency = 4;
+  // Limit grows by one per limit requests served within it and is cut by a tenth per slower one
+  std::chrono::microseconds target_service_time = std::chrono::milliseconds(10);
+  // Request that waits longer is rejected instead of being served late
+  std::chrono::microseconds max_queue_wait = std::chrono::milliseconds(100);
+};
+
+struct FindRequestResult {
+  std::vector<Document> documents;
+  bool is_rejected = false;
+  std::chrono::nanoseconds queue_wait{};
+  std::chrono::nanoseconds service_time{};
+};
+
+struct AdmissionStats {
+  std::array<uint64_t, REQUEST_PRIORITY_COUNT> admitted_counts{};
+  std::array<uint64_t, REQUEST_PRIORITY_COUNT> rejected_counts{};
+  std::chrono::nanoseconds total_queue_wait{};
+  std::chrono::nanoseconds total_service_time{};
+  double concurrency_limit = 0;
+};
+
 class RequestQueue {
  public:
-  explicit RequestQueue(const SearchServer &search_server);
+  explicit RequestQueue(const SearchServer &search_server, const AdmissionOptions &options = {});
 
   template<typename DocumentPredicate>
   std::vector<Document> AddFindRequest(const std::string &raw_query,
@@ -19,9 +61,22 @@ class RequestQueue {
 
   std::vector<Document> AddFindRequest(const std::string &raw_query);
 
+  // Safe to call from many threads. The request runs on the calling thread once a slot is
+  // free, it is rejected without running if the wait queue is saturated or it waits too long
+  FindRequestResult SubmitFindRequest(const std::string &raw_query,
+                                      DocumentStatus status = DocumentStatus::ACTUAL,
+                                      RequestPriority priority = RequestPriority::NORMAL);
+
   int GetNoResultRequests() const;
 
+  // Requests GetNoResultRequests counts over, the most recent day of them
+  size_t GetWindowRequestCount() const;
+
+  AdmissionStats GetAdmissionStats() const;
+
  private:
+  using Clock = std::chrono::steady_clock;
+
   struct QueryResult {
     uint64_t timestamp;
     bool isEmpty;
@@ -30,10 +85,26 @@ class RequestQueue {
   std::deque<QueryResult> requests_;
   const static int min_in_day_ = 1440;
   const SearchServer &search_server_;
-  uint64_t time_count;
+  uint64_t time_count = 0;
   int noResultsRequestsCount = 0;
 
+  const AdmissionOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable admission_state_changed_;
+  // Tickets of the waiting requests per priority in arrival order
+  std::array<std::deque<uint64_t>, REQUEST_PRIORITY_COUNT> waiting_tickets_;
+  size_t waiting_count_ = 0;
+  uint64_t next_ticket_ = 0;
+  int running_count_ = 0;
+  double concurrency_limit_;
+  AdmissionStats stats_;
+
   void OnNewRequest(bool isResultEmpty);
+
+  // Both take mutex_ held
+  bool CanRun(uint64_t ticket) const;
+
+  void OnRequestServed(Clock::duration service_time);
 };
 
 template<typename DocumentPredicate>
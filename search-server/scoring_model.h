@@ -0,0 +1,63 @@
+#pragma once
+
+#include "document_column.h"
+
+#include <cmath>
+#include <cstddef>
+
+struct CorpusStats {
+  int document_count;
+  // Non-stop word count indexed by document id
+  const DocumentColumn &document_lengths;
+  double average_document_length;
+};
+
+// Scoring models are compile-time policies of FindTopDocuments. A model is constructed once per
+// query, ComputeWordWeight is called once per query word and Score once per posting,
+// term_freq being the share of the document's words taken by the query word
+
+class TfIdf {
+ public:
+  explicit TfIdf(const CorpusStats &stats) : document_count_(stats.document_count) {
+  }
+
+  double ComputeWordWeight(size_t document_freq) const {
+    return std::log(document_count_ * 1.0 / document_freq);
+  }
+
+  double Score(double word_weight, double term_freq, int /*document_id*/) const {
+    return term_freq * word_weight;
+  }
+
+ private:
+  int document_count_;
+};
+
+class Bm25 {
+ public:
+  static constexpr double K1 = 1.2;
+  static constexpr double B = 0.75;
+
+  explicit Bm25(const CorpusStats &stats)
+      : document_count_(stats.document_count),
+        document_lengths_(&stats.document_lengths),
+        length_norm_(K1 * B / stats.average_document_length) {
+  }
+
+  double ComputeWordWeight(size_t document_freq) const {
+    return std::log(1.0 + (document_count_ - document_freq + 0.5) / (document_freq + 0.5));
+  }
+
+  double Score(double word_weight, double term_freq, int document_id) const {
+    const double length = document_lengths_->Get(document_id);
+    const double word_count = term_freq * length;
+    return word_weight * word_count * (K1 + 1)
+        / (word_count + K1 * (1 - B) + length_norm_ * length);
+  }
+
+ private:
+  double document_count_;
+  const DocumentColumn *document_lengths_;
+  // Constant part of the length normalization, precomputed once per query
+  double length_norm_;
+};
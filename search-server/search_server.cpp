@@ -1,10 +1,22 @@
 #include "search_server.h"
 
+#include <atomic>
+#include <chrono>
 #include <numeric>
 #include <cmath>
+#include <unordered_map>
 
 using namespace std;
 
+// Calibration queries have this many words and start at this many postings, each next one
+// has CALIBRATION_POSTING_GROWTH times more
+const size_t CALIBRATION_QUERY_WORD_COUNT = 4;
+const size_t CALIBRATION_MIN_POSTING_COUNT = 1024;
+const size_t CALIBRATION_POSTING_GROWTH = 4;
+
+// Best of this many runs is taken as a calibration query's time
+const int CALIBRATION_RUN_COUNT = 3;
+
 SearchServer::SearchServer(string_view stop_words_text) : SearchServer(
     SplitIntoWords(stop_words_text)) {
 }
@@ -13,43 +25,383 @@ SearchServer::SearchServer(const string &stop_words_text) : SearchServer(
     string_view(stop_words_text)) {
 }
 
+void SearchServer::EnablePositionalIndex() {
+  if (!documents_.empty()) {
+    throw invalid_argument("Positional index must be enabled before adding documents"s);
+  }
+  store_positions_ = true;
+}
+
+void SearchServer::SetTextAnalyzer(const TextAnalyzer &analyzer) {
+  if (!documents_.empty()) {
+    throw invalid_argument("Text analyzer must be set before adding documents"s);
+  }
+  set<string, less<>> stop_words;
+  for (const string &stop_word : stop_words_) {
+    const string normalized_stop_word = analyzer.Normalize(stop_word);
+    for (const string_view word : SplitIntoWords(normalized_stop_word)) {
+      stop_words.emplace(word);
+    }
+  }
+  stop_words_ = StopWordSet(stop_words);
+  text_analyzer_ = analyzer;
+}
+
+void SearchServer::SetFuzzyMatchPenalty(double penalty) {
+  if (!(penalty > 0 && penalty <= 1)) {
+    throw invalid_argument("Fuzzy match penalty must be in (0, 1]"s);
+  }
+  fuzzy_match_penalty_ = penalty;
+}
+
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
                                const vector<int> &ratings) {
+  AddDocument(document_id, TokenizeDocument(document), status, ratings);
+}
+
+TokenizedDocument SearchServer::TokenizeDocument(string_view document) const {
+  TRACE_SCOPE("TokenizeDocument");
+  if (!IsValidWord(document)) {
+    throw invalid_argument("Document contains forbidden symbols"s);
+  }
+  TokenizedDocument tokenized_document;
+  if (!text_analyzer_.IsIdentity()) {
+    tokenized_document.normalized_text = make_shared<const string>(text_analyzer_.Normalize(document));
+    document = *tokenized_document.normalized_text;
+  }
+  const vector<string_view> all_words = SplitIntoWords(document);
+  for (uint32_t position = 0; position < all_words.size(); ++position) {
+    if (!IsStopWord(all_words[position])) {
+      tokenized_document.words.push_back(all_words[position]);
+      tokenized_document.positions.push_back(position);
+    }
+  }
+  return tokenized_document;
+}
+
+void SearchServer::AddDocument(int document_id, const TokenizedDocument &document,
+                               DocumentStatus status, const vector<int> &ratings) {
+  TRACE_SCOPE("AddDocument");
   if (document_id < 0) {
     throw invalid_argument("Document id must not be negative"s);
   }
   if (documents_.count(document_id)) {
     throw invalid_argument("Document with id "s + to_string(document_id) + " already exists"s);
   }
-  if (!IsValidWord(document)) {
-    throw invalid_argument("Document contains forbidden symbols"s);
+  if (removed_documents_.Test(document_id)) {
+    PurgeRemovedDocument(document_id);
   }
-  const vector<string_view> words = SplitIntoWordsNoStop(document);
+  const vector<string_view> &words = document.words;
   const double inv_word_count = 1.0 / words.size();
+  // Occurrences are counted first, quantized term frequencies must not be accumulated
+  map<string_view, int> word_counts;
   for (const string_view word : words) {
-    word_to_document_freqs_[string(word)][document_id] += inv_word_count;
-    document_to_word_freqs_[document_id][string(word)] += inv_word_count;
+    ++word_counts[word];
+  }
+  DocumentWords &document_words = document_to_word_freqs_[document_id];
+  document_words.postings.reserve(word_counts.size());
+  for (const auto [word, count] : word_counts) {
+    auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
+    if (word_to_document_freqs_it == word_to_document_freqs_.end()) {
+      word_to_document_freqs_it = word_to_document_freqs_.emplace(string(word), PostingList{}).first;
+    }
+    const TermFreq term_freq = count * inv_word_count;
+    word_to_document_freqs_it->second.document_freqs.emplace(document_id, term_freq);
+    // Views must point to the index keys, they outlive the document text
+    document_words.word_freqs.emplace_hint(document_words.word_freqs.end(), word_to_document_freqs_it->first, term_freq);
+    document_words.postings.push_back(&word_to_document_freqs_it->second);
   }
-  documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+  if (store_positions_) {
+    for (size_t i = 0; i < words.size(); ++i) {
+      word_to_document_positions_[string(words[i])][document_id].Append(document.positions[i]);
+    }
+  }
+  const int rating = ComputeAverageRating(ratings);
+  documents_.emplace(document_id, DocumentData{rating, status});
   document_ids_.insert(document_id);
+  status_to_documents_[static_cast<int>(status)].Set(document_id);
+  document_ratings_.Insert(document_id, rating);
+  document_lengths_.Insert(document_id, words.size());
+  total_document_length_ += words.size();
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query,
                                                 DocumentStatus status) const {
-  return FindTopDocuments(
-      raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-      });
+  return FindTopDocuments(execution::seq, raw_query, status);
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query,
+                                                const FilterExpression &filter) const {
+  return FindTopDocuments(execution::seq, raw_query, filter);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
   return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+ExecutionCalibration SearchServer::CalibrateExecution() {
+  ExecutionCalibration calibration;
+  calibration.min_parallel_posting_count = numeric_limits<size_t>::max();
+  // Indexed words that parse back as plain query words, by posting count
+  vector<pair<size_t, string_view>> words;
+  for (const auto &[word, posting_list] : word_to_document_freqs_) {
+    if (!posting_list.document_freqs.empty() && word.find_first_of("-*~\""s) == string::npos) {
+      words.emplace_back(posting_list.document_freqs.size(), word);
+    }
+  }
+  sort(words.begin(), words.end());
+  const auto measure = [this](const auto &policy, const string &raw_query) {
+    auto best_time = chrono::steady_clock::duration::max();
+    for (int run = 0; run < CALIBRATION_RUN_COUNT; ++run) {
+      const auto start_time = chrono::steady_clock::now();
+      FindTopDocuments(policy, raw_query);
+      best_time = min(best_time, chrono::steady_clock::now() - start_time);
+    }
+    return best_time;
+  };
+  for (size_t target_count = CALIBRATION_MIN_POSTING_COUNT;
+       calibration.max_thread_count > 1 && words.size() >= CALIBRATION_QUERY_WORD_COUNT;
+       target_count *= CALIBRATION_POSTING_GROWTH) {
+    // Consecutive words of about target_count / CALIBRATION_QUERY_WORD_COUNT postings each,
+    // or the most frequent words once no query reaches target_count
+    const auto first_it = lower_bound(words.begin(), words.end(),
+                                      pair{target_count / CALIBRATION_QUERY_WORD_COUNT, string_view()});
+    const size_t first = min<size_t>(first_it - words.begin(), words.size() - CALIBRATION_QUERY_WORD_COUNT);
+    string raw_query;
+    size_t posting_count = 0;
+    for (size_t i = first; i < first + CALIBRATION_QUERY_WORD_COUNT; ++i) {
+      raw_query += words[i].second;
+      raw_query += ' ';
+      posting_count += words[i].first;
+    }
+    if (measure(execution::par, raw_query) < measure(execution::seq, raw_query)) {
+      // Queries at the crossover get two threads, twice the cost pays for two more
+      calibration.min_parallel_posting_count = posting_count;
+      calibration.postings_per_thread = max<size_t>(posting_count / 2, 1);
+      break;
+    }
+    if (first + CALIBRATION_QUERY_WORD_COUNT == words.size()) {
+      break;
+    }
+  }
+  execution_calibration_ = calibration;
+  return calibration;
+}
+
+void SearchServer::SetExecutionCalibration(const ExecutionCalibration &calibration) {
+  if (calibration.postings_per_thread == 0 || calibration.max_thread_count == 0) {
+    throw invalid_argument("Postings per thread and thread count must be positive"s);
+  }
+  execution_calibration_ = calibration;
+}
+
+const ExecutionCalibration &SearchServer::GetExecutionCalibration() const {
+  return execution_calibration_;
+}
+
+size_t SearchServer::ChooseThreadCount(string_view raw_query) const {
+  const Query query = GetValidParsedQuery(raw_query);
+  return ChooseThreadCount(query, ResolvePostings(query));
+}
+
+SearchServer::PreparedQuery SearchServer::Prepare(string_view raw_query) const {
+  PreparedQuery prepared_query;
+  prepared_query.text_ = make_shared<const string>(raw_query);
+  prepared_query.query_ = GetValidParsedQuery(*prepared_query.text_);
+  prepared_query.postings_ = ResolveWordPostings(prepared_query.query_);
+  prepared_query.server_ = this;
+  prepared_query.dictionary_version_ = dictionary_version_.Get();
+  prepared_query.word_count_ = word_to_document_freqs_.size();
+  return prepared_query;
+}
+
+void SearchServer::BuildImpactIndex() {
+  const TfIdf scoring_model(GetCorpusStats());
+  map<string_view, vector<pair<int, double>>> word_to_scores;
+  double max_score = 0;
+  for (const auto &[word, posting_list] : word_to_document_freqs_) {
+    const size_t document_freq = posting_list.GetDocumentFreq();
+    if (document_freq == 0) {
+      continue;
+    }
+    const double word_weight = scoring_model.ComputeWordWeight(document_freq);
+    vector<pair<int, double>> &scores = word_to_scores[word];
+    for (const auto [document_id, term_freq] : posting_list.document_freqs) {
+      if (!removed_documents_.Test(document_id)) {
+        scores.emplace_back(document_id, scoring_model.Score(word_weight, term_freq, document_id));
+        max_score = max(max_score, scores.back().second);
+      }
+    }
+  }
+  impact_scale_ = max_score / MAX_IMPACT;
+  word_to_impact_postings_.clear();
+  for (const auto &[word, scores] : word_to_scores) {
+    vector<ImpactPosting> &postings = word_to_impact_postings_[string(word)];
+    postings.reserve(scores.size());
+    for (const auto &[document_id, score] : scores) {
+      const long impact = impact_scale_ > 0 ? lround(score / impact_scale_) : 0;
+      postings.push_back({document_id, static_cast<uint8_t>(score > 0 ? max(impact, 1l) : 0)});
+    }
+    sort(postings.begin(), postings.end(), [](const ImpactPosting &lhs, const ImpactPosting &rhs) {
+      return lhs.impact > rhs.impact || (lhs.impact == rhs.impact && lhs.document_id < rhs.document_id);
+    });
+  }
+  has_impact_index_ = true;
+}
+
+vector<Document> SearchServer::FindTopDocumentsByImpact(string_view raw_query,
+                                                        DocumentStatus status,
+                                                        size_t posting_budget) const {
+  if (!has_impact_index_) {
+    throw invalid_argument("Impact queries require impact index"s);
+  }
+  const Query query = GetValidParsedQuery(raw_query);
+  if (!query.phrases.empty() || !query.plus_prefixes.empty() || !query.minus_prefixes.empty()
+      || !query.fuzzy_words.empty()) {
+    throw invalid_argument("Impact queries support plain words only"s);
+  }
+  const Bitmap &status_documents = GetStatusDocuments(status);
+  const QueryPostings postings = ResolveWordPostings(query);
+  Bitmap excluded_documents;
+  for (const PostingList *posting_list : postings.minus_word_freqs) {
+    if (posting_list) {
+      for (const auto [document_id, _] : posting_list->document_freqs) {
+        excluded_documents.Set(document_id);
+      }
+    }
+  }
+
+  struct Cursor {
+    vector<ImpactPosting>::const_iterator it;
+    vector<ImpactPosting>::const_iterator end;
+  };
+  vector<Cursor> cursors;
+  for (const string_view word : query.plus_words) {
+    const auto word_to_impact_postings_it = word_to_impact_postings_.find(word);
+    if (word_to_impact_postings_it != word_to_impact_postings_.end()) {
+      cursors.push_back({word_to_impact_postings_it->second.begin(), word_to_impact_postings_it->second.end()});
+    }
+  }
+
+  const size_t top_count = MAX_RESULT_DOCUMENT_COUNT;
+  // Accumulator holds only the documents the traversal reaches, not one slot per id
+  size_t posting_count = 0;
+  for (const Cursor &cursor : cursors) {
+    posting_count += cursor.end - cursor.it;
+  }
+  unordered_map<int, uint32_t> scores;
+  scores.reserve(min(posting_count, posting_budget));
+  vector<int> matched_ids;
+  // Scores only grow, so tracking the top_count + 1 best documents incrementally is exact
+  vector<int> top_ids;
+  const auto update_top = [&scores, &top_ids, top_count](int document_id) {
+    if (find(top_ids.begin(), top_ids.end(), document_id) != top_ids.end()) {
+      return;
+    }
+    if (top_ids.size() <= top_count) {
+      top_ids.push_back(document_id);
+      return;
+    }
+    const auto min_it = min_element(top_ids.begin(), top_ids.end(), [&scores](int lhs, int rhs) {
+      return scores.at(lhs) < scores.at(rhs);
+    });
+    if (scores.at(document_id) > scores.at(*min_it)) {
+      *min_it = document_id;
+    }
+  };
+
+  // Score-at-a-time: the run of postings with the highest impact left among all words goes next
+  while (posting_budget > 0) {
+    const auto cursor_it = max_element(cursors.begin(), cursors.end(), [](const Cursor &lhs, const Cursor &rhs) {
+      return (lhs.it == lhs.end ? -1 : lhs.it->impact) < (rhs.it == rhs.end ? -1 : rhs.it->impact);
+    });
+    if (cursor_it == cursors.end() || cursor_it->it == cursor_it->end) {
+      break;
+    }
+    Cursor &cursor = *cursor_it;
+    const uint8_t impact = cursor.it->impact;
+    for (; cursor.it != cursor.end && cursor.it->impact == impact && posting_budget > 0; ++cursor.it, --posting_budget) {
+      const int document_id = cursor.it->document_id;
+      if (!status_documents.Test(document_id) || excluded_documents.Test(document_id)) {
+        continue;
+      }
+      const auto [score_it, is_new] = scores.try_emplace(document_id, 0);
+      if (is_new) {
+        matched_ids.push_back(document_id);
+      }
+      score_it->second += impact;
+      update_top(document_id);
+    }
+
+    // Stop once the last place of the top cannot be taken by anyone else, even if every
+    // remaining posting went to the runner-up
+    uint32_t remaining_impact = 0;
+    for (const Cursor &other_cursor : cursors) {
+      if (other_cursor.it != other_cursor.end) {
+        remaining_impact += other_cursor.it->impact;
+      }
+    }
+    vector<uint32_t> top_scores;
+    for (const int document_id : top_ids) {
+      top_scores.push_back(scores.at(document_id));
+    }
+    sort(top_scores.begin(), top_scores.end(), greater<>());
+    const uint32_t last_score = top_scores.size() >= top_count ? top_scores[top_count - 1] : 0;
+    const uint32_t runner_up_score = top_scores.size() > top_count ? top_scores[top_count] : 0;
+    if (last_score >= runner_up_score + remaining_impact) {
+      break;
+    }
+  }
+
+  // Traversal settles which documents make the top, not their order, so they are rescored
+  // exactly from the main index
+  const size_t result_count = min(matched_ids.size(), top_count);
+  partial_sort(matched_ids.begin(),
+               matched_ids.begin() + result_count,
+               matched_ids.end(),
+               [&scores](int lhs, int rhs) {
+                 const uint32_t lhs_score = scores.at(lhs);
+                 const uint32_t rhs_score = scores.at(rhs);
+                 return lhs_score > rhs_score || (lhs_score == rhs_score && lhs < rhs);
+               });
+  const TfIdf scoring_model(GetCorpusStats());
+  vector<Document> matched_documents;
+  matched_documents.reserve(result_count);
+  for (size_t i = 0; i < result_count; ++i) {
+    const int document_id = matched_ids[i];
+    double relevance = 0;
+    for (size_t word_index = 0; word_index < postings.plus_word_freqs.size(); ++word_index) {
+      const PostingList *posting_list = postings.plus_word_freqs[word_index];
+      if (!posting_list) {
+        continue;
+      }
+      const auto document_freqs_it = posting_list->document_freqs.find(document_id);
+      if (document_freqs_it != posting_list->document_freqs.end()) {
+        relevance += scoring_model.Score(scoring_model.ComputeWordWeight(posting_list->GetDocumentFreq()),
+                                         document_freqs_it->second,
+                                         document_id);
+      }
+    }
+    matched_documents.push_back({document_id, relevance, document_ratings_.Get(document_id)});
+  }
+  sort(matched_documents.begin(), matched_documents.end(), IsRankedBefore);
+  return matched_documents;
+}
+
 int SearchServer::GetDocumentCount() const {
   return document_ids_.size();
 }
 
+size_t SearchServer::GetPositionalIndexByteSize() const {
+  size_t byte_size = 0;
+  for (const auto &[word, document_positions] : word_to_document_positions_) {
+    for (const auto &[_, positions] : document_positions) {
+      byte_size += sizeof(int) + positions.ByteSize();
+    }
+  }
+  return byte_size;
+}
+
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query,
                                                                        int document_id) const {
 //  LOG_DURATION_STREAM("Operation time", cout);
@@ -57,26 +409,80 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_vi
     throw out_of_range("Document is invalid"s);
   }
   const Query query = GetValidParsedQuery(raw_query);
-  for (string_view word : query.minus_words) {
-    const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
-    if (word_to_document_freqs_it == word_to_document_freqs_.end()) {
-      continue;
+  auto [matched_words, status, _] = MatchQuery(query, ResolveWordPostings(query), document_id, QueryDeadline());
+  return {move(matched_words), status};
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const PreparedQuery &query,
+                                                                       int document_id) const {
+  if (document_id < 0 || !document_ids_.count(document_id)) {
+    throw out_of_range("Document is invalid"s);
+  }
+  auto [matched_words, status, _] = MatchQuery(query.query_, GetWordPostings(query), document_id, QueryDeadline());
+  return {move(matched_words), status};
+}
+
+tuple<vector<string_view>, DocumentStatus, bool> SearchServer::MatchDocument(string_view raw_query,
+                                                                             int document_id,
+                                                                             const QueryDeadline &deadline) const {
+  if (document_id < 0 || !document_ids_.count(document_id)) {
+    throw out_of_range("Document is invalid"s);
+  }
+  const Query query = GetValidParsedQuery(raw_query);
+  return MatchQuery(query, ResolveWordPostings(query), document_id, deadline);
+}
+
+tuple<vector<string_view>, DocumentStatus, bool> SearchServer::MatchQuery(const Query &query,
+                                                                          const QueryPostings &postings,
+                                                                          int document_id,
+                                                                          const QueryDeadline &deadline) const {
+  const DocumentStatus status = documents_.at(document_id).status;
+  for (const PostingList *posting_list : postings.minus_word_freqs) {
+    if (posting_list && posting_list->document_freqs.count(document_id)) {
+      return {vector<string_view>{}, status, false};
     }
-    if (word_to_document_freqs_it->second.count(document_id)) {
-      return {vector<string_view>{}, documents_.at(document_id).status};
+  }
+  for (string_view prefix : query.minus_prefixes) {
+    if (!FindDocumentWordsWithPrefix(document_id, prefix).empty()) {
+      return {vector<string_view>{}, status, false};
     }
   }
+  // Phrases, prefixes and fuzzy words only scan the document's own words, plus words are
+  // the unbounded part. Each of them is a posting lookup, so the deadline is polled per word
+  DeadlineCheck deadline_check(deadline);
   vector<string_view> matched_words;
-  for (string_view word : query.plus_words) {
-    const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
-    if (word_to_document_freqs_it == word_to_document_freqs_.end()) {
-      continue;
+  for (size_t i = 0; i < query.plus_words.size(); ++i) {
+    if (deadline_check.IsExpired()) {
+      PointIntoIndex(query, matched_words);
+      return {matched_words, status, true};
     }
-    if (word_to_document_freqs_it->second.count(document_id)) {
+    const PostingList *posting_list = postings.plus_word_freqs[i];
+    if (posting_list && posting_list->document_freqs.count(document_id)) {
+      matched_words.push_back(query.plus_words[i]);
+    }
+  }
+  vector<string_view> extra_words;
+  for (const Phrase &phrase : query.phrases) {
+    if (DocumentContainsPhrase(phrase, document_id)) {
+      extra_words.insert(extra_words.end(), phrase.words.begin(), phrase.words.end());
+    }
+  }
+  PointIntoIndex(query, matched_words);
+  PointIntoIndex(query, extra_words);
+  for (string_view prefix : query.plus_prefixes) {
+    const vector<string_view> words = FindDocumentWordsWithPrefix(document_id, prefix);
+    extra_words.insert(extra_words.end(), words.begin(), words.end());
+  }
+  for (const FuzzyWord &fuzzy_word : query.fuzzy_words) {
+    const vector<string_view> words = FindDocumentWordsWithinDistance(document_id, fuzzy_word);
+    extra_words.insert(extra_words.end(), words.begin(), words.end());
+  }
+  for (string_view word : extra_words) {
+    if (find(matched_words.begin(), matched_words.end(), word) == matched_words.end()) {
       matched_words.push_back(word);
     }
   }
-  return {matched_words, documents_.at(document_id).status};
+  return {matched_words, status, false};
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
@@ -101,7 +507,13 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
       query.minus_words.end(),
       [this, document_id](string_view word) {
         const auto it = word_to_document_freqs_.find(word);
-        return it != word_to_document_freqs_.end() && it->second.count(document_id);
+        return it != word_to_document_freqs_.end() && it->second.document_freqs.count(document_id);
+      }
+  ) || any_of(
+      query.minus_prefixes.begin(),
+      query.minus_prefixes.end(),
+      [this, document_id](string_view prefix) {
+        return !FindDocumentWordsWithPrefix(document_id, prefix).empty();
       }
   )) {
     return {vector<string_view>{}, documents_.at(document_id).status};
@@ -114,12 +526,25 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
       matched_words.begin(),
       [this, document_id](string_view word) {
         const auto it = word_to_document_freqs_.find(word);
-        if (it != word_to_document_freqs_.end() && it->second.count(document_id)) {
+        if (it != word_to_document_freqs_.end() && it->second.document_freqs.count(document_id)) {
           return word;
         }
         return string_view{};
       }
   );
+  for (const Phrase &phrase : query.phrases) {
+    if (DocumentContainsPhrase(phrase, document_id)) {
+      matched_words.insert(matched_words.end(), phrase.words.begin(), phrase.words.end());
+    }
+  }
+  for (string_view prefix : query.plus_prefixes) {
+    const vector<string_view> words = FindDocumentWordsWithPrefix(document_id, prefix);
+    matched_words.insert(matched_words.end(), words.begin(), words.end());
+  }
+  for (const FuzzyWord &fuzzy_word : query.fuzzy_words) {
+    const vector<string_view> words = FindDocumentWordsWithinDistance(document_id, fuzzy_word);
+    matched_words.insert(matched_words.end(), words.begin(), words.end());
+  }
   sort(
       policy,
       matched_words.begin(),
@@ -138,19 +563,46 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
   return {matched_words, documents_.at(document_id).status};
 }
 
-const map<string_view, double> &SearchServer::GetWordFrequencies(int document_id) const {
+DocumentMatches SearchServer::MatchDocuments(string_view raw_query,
+                                             const vector<int> &document_ids) const {
+  return MatchDocuments(execution::seq, raw_query, document_ids);
+}
+
+const map<string_view, TermFreq> &SearchServer::GetWordFrequencies(int document_id) const {
   const auto it = document_to_word_freqs_.find(document_id);
-  if (it == document_to_word_freqs_.end()) {
-    static const map<string_view, double> empty_map;
+  if (it == document_to_word_freqs_.end() || removed_documents_.Test(document_id)) {
+    static const map<string_view, TermFreq> empty_map;
     return empty_map;
   }
-  return it->second;
+  return it->second.word_freqs;
+}
+
+void SearchServer::SetDocumentStatus(int document_id, DocumentStatus status) {
+  const auto documents_it = documents_.find(document_id);
+  if (documents_it == documents_.end()) {
+    throw out_of_range("Document is invalid"s);
+  }
+  DocumentStatus &document_status = documents_it->second.status;
+  status_to_documents_[static_cast<int>(document_status)].Reset(document_id);
+  status_to_documents_[static_cast<int>(status)].Set(document_id);
+  document_status = status;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
   return RemoveDocument(execution::seq, document_id);
 }
 
+void SearchServer::SetCompactionThreshold(double garbage_ratio) {
+  if (!(garbage_ratio > 0 && garbage_ratio <= 1)) {
+    throw invalid_argument("Garbage ratio must be in (0, 1]"s);
+  }
+  compaction_garbage_ratio_ = garbage_ratio;
+}
+
+void SearchServer::CompactPostings() {
+  CompactPostings(execution::seq);
+}
+
 set<int>::const_iterator SearchServer::begin() const {
   return document_ids_.begin();
 }
@@ -159,18 +611,58 @@ set<int>::const_iterator SearchServer::end() const {
   return document_ids_.end();
 }
 
-bool SearchServer::IsStopWord(string_view word) const {
-  return stop_words_.count(word) > 0;
+void SearchServer::PurgeRemovedDocument(int document_id) {
+  TRACE_SCOPE("PurgeRemovedDocument");
+  const auto document_to_word_freqs_it = document_to_word_freqs_.find(document_id);
+  if (document_to_word_freqs_it != document_to_word_freqs_.end()) {
+    for (PostingList *posting_list : GetDocumentPostings(document_to_word_freqs_it->second)) {
+      posting_list->document_freqs.erase(document_id);
+      --posting_list->removed_document_count;
+    }
+    for (const auto &[word, _] : document_to_word_freqs_it->second.word_freqs) {
+      const auto word_to_document_positions_it = word_to_document_positions_.find(word);
+      if (word_to_document_positions_it != word_to_document_positions_.end()) {
+        word_to_document_positions_it->second.erase(document_id);
+      }
+    }
+    document_to_word_freqs_.erase(document_to_word_freqs_it);
+  }
+  removed_documents_.Reset(document_id);
+  --removed_document_count_;
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view text) const {
-  vector<string_view> words;
-  for (const string_view word : SplitIntoWords(text)) {
-    if (!IsStopWord(word)) {
-      words.push_back(word);
+const vector<SearchServer::PostingList *> &SearchServer::GetDocumentPostings(DocumentWords &document_words) {
+  if (document_words.postings.size() != document_words.word_freqs.size()) {
+    LinkDocumentPostings();
+  }
+  return document_words.postings;
+}
+
+void SearchServer::LinkDocumentPostings() {
+  TRACE_SCOPE("LinkDocumentPostings");
+  vector<pair<int, DocumentWords *>> documents;
+  documents.reserve(document_to_word_freqs_.size());
+  for (auto &[document_id, document_words] : document_to_word_freqs_) {
+    document_words.postings.clear();
+    document_words.postings.reserve(document_words.word_freqs.size());
+    documents.emplace_back(document_id, &document_words);
+  }
+  // Lists are swept in word order, so each document gets its links in the order of its words
+  for (auto &[_, posting_list] : word_to_document_freqs_) {
+    // Postings are sorted by id as well, each search starts past the previous document
+    auto documents_it = documents.begin();
+    for (const auto [document_id, _] : posting_list.document_freqs) {
+      documents_it = lower_bound(documents_it, documents.end(), document_id, [](const auto &document, int id) {
+        return document.first < id;
+      });
+      documents_it->second->postings.push_back(&posting_list);
+      ++documents_it;
     }
   }
-  return words;
+}
+
+bool SearchServer::IsStopWord(string_view word) const {
+  return stop_words_.Contains(word);
 }
 
 int SearchServer::ComputeAverageRating(const vector<int> &ratings) {
@@ -188,35 +680,97 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
     is_minus = true;
     text = text.substr(1);
   }
-  return {text, is_minus, IsStopWord(text)};
+  const size_t tilde_pos = text.rfind('~');
+  if (tilde_pos != string_view::npos && tilde_pos + 2 >= text.size()) {
+    const string_view distance = text.substr(tilde_pos + 1);
+    if (distance.empty()) {
+      return {text.substr(0, tilde_pos), is_minus, false, false, 1};
+    }
+    if (distance[0] >= '1' && distance[0] <= '0' + MAX_FUZZY_DISTANCE) {
+      return {text.substr(0, tilde_pos), is_minus, false, false, distance[0] - '0'};
+    }
+  }
+  if (!text.empty() && text.back() == '*') {
+    return {text.substr(0, text.size() - 1), is_minus, false, true, 0};
+  }
+  return {text, is_minus, IsStopWord(text), false, 0};
+}
+
+SearchServer::Phrase SearchServer::ParsePhrase(string_view text) const {
+  Phrase phrase;
+  const vector<string_view> words = SplitIntoWords(text);
+  uint32_t first_position = 0;
+  for (uint32_t position = 0; position < words.size(); ++position) {
+    if (!IsStopWord(words[position])) {
+      if (phrase.words.empty()) {
+        first_position = position;
+      }
+      phrase.words.push_back(words[position]);
+      phrase.offsets.push_back(position - first_position);
+    }
+  }
+  return phrase;
 }
 
 SearchServer::Query SearchServer::ParseQueryUnique(string_view text) const {
   Query query;
   set<string_view> plus_words;
   set<string_view> minus_words;
-  for (string_view word : SplitIntoWords(text)) {
-    const QueryWord query_word = ParseQueryWord(word);
-    if (!query_word.is_stop) {
-      if (query_word.is_minus) {
-        minus_words.insert(query_word.data);
-      } else {
-        plus_words.insert(query_word.data);
+  const vector<string_view> segments = SplitByQuotes(text);
+  for (size_t i = 0; i < segments.size(); ++i) {
+    if (i % 2) {
+      Phrase phrase = ParsePhrase(segments[i]);
+      if (!phrase.words.empty()) {
+        query.phrases.push_back(move(phrase));
+      }
+      continue;
+    }
+    for (string_view word : SplitIntoWords(segments[i])) {
+      const QueryWord query_word = ParseQueryWord(word);
+      if (query_word.max_distance) {
+        query.fuzzy_words.push_back({query_word.data, query_word.max_distance, query_word.is_minus});
+      } else if (query_word.is_prefix) {
+        auto &prefixes = query_word.is_minus ? query.minus_prefixes : query.plus_prefixes;
+        if (find(prefixes.begin(), prefixes.end(), query_word.data) == prefixes.end()) {
+          prefixes.push_back(query_word.data);
+        }
+      } else if (!query_word.is_stop) {
+        if (query_word.is_minus) {
+          minus_words.insert(query_word.data);
+        } else {
+          plus_words.insert(query_word.data);
+        }
       }
     }
   }
-  return {{plus_words.begin(), plus_words.end()}, {minus_words.begin(), minus_words.end()}};
+  query.plus_words.assign(plus_words.begin(), plus_words.end());
+  query.minus_words.assign(minus_words.begin(), minus_words.end());
+  return query;
 }
 
 SearchServer::Query SearchServer::ParseQuery(string_view text) const {
   Query query;
-  for (string_view word : SplitIntoWords(text)) {
-    const QueryWord query_word = ParseQueryWord(word);
-    if (!query_word.is_stop) {
-      if (query_word.is_minus) {
-        query.minus_words.push_back(query_word.data);
-      } else {
-        query.plus_words.push_back(query_word.data);
+  const vector<string_view> segments = SplitByQuotes(text);
+  for (size_t i = 0; i < segments.size(); ++i) {
+    if (i % 2) {
+      Phrase phrase = ParsePhrase(segments[i]);
+      if (!phrase.words.empty()) {
+        query.phrases.push_back(move(phrase));
+      }
+      continue;
+    }
+    for (string_view word : SplitIntoWords(segments[i])) {
+      const QueryWord query_word = ParseQueryWord(word);
+      if (query_word.max_distance) {
+        query.fuzzy_words.push_back({query_word.data, query_word.max_distance, query_word.is_minus});
+      } else if (query_word.is_prefix) {
+        (query_word.is_minus ? query.minus_prefixes : query.plus_prefixes).push_back(query_word.data);
+      } else if (!query_word.is_stop) {
+        if (query_word.is_minus) {
+          query.minus_words.push_back(query_word.data);
+        } else {
+          query.plus_words.push_back(query_word.data);
+        }
       }
     }
   }
@@ -228,18 +782,265 @@ SearchServer::Query SearchServer::GetValidParsedQuery(string_view raw_query,
   if (!IsValidWord(raw_query)) {
     throw invalid_argument("Query contains forbidden symbols"s);
   }
+  if (count(raw_query.begin(), raw_query.end(), '"') % 2) {
+    throw invalid_argument("Query contains unclosed quote"s);
+  }
+  shared_ptr<const string> normalized_text;
+  if (!text_analyzer_.IsIdentity()) {
+    normalized_text = make_shared<const string>(text_analyzer_.NormalizeQuery(raw_query));
+    raw_query = *normalized_text;
+  }
   Query query = uniqueWords ? ParseQueryUnique(raw_query) : ParseQuery(raw_query);
+  query.normalized_text = move(normalized_text);
   for (auto &word : query.minus_words) {
     if (word.empty() || word[0] == '-') {
       throw invalid_argument("Invalid query"s);
     }
   }
+  for (const auto *prefixes : {&query.plus_prefixes, &query.minus_prefixes}) {
+    for (const string_view prefix : *prefixes) {
+      if (prefix.empty() || prefix[0] == '-') {
+        throw invalid_argument("Invalid query"s);
+      }
+    }
+  }
+  for (const FuzzyWord &fuzzy_word : query.fuzzy_words) {
+    // Excluding every document with a similar word is almost never intended
+    if (fuzzy_word.data.empty() || fuzzy_word.is_minus) {
+      throw invalid_argument("Invalid query"s);
+    }
+  }
+  if (!query.phrases.empty() && !store_positions_) {
+    throw invalid_argument("Phrase queries require positional index"s);
+  }
   return query;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-  return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(string(word)).size());
+void SearchServer::PointIntoIndex(const Query &query, vector<string_view> &words) const {
+  if (!query.normalized_text) {
+    return;
+  }
+  // Words are never erased from the index, views into it stay valid
+  for (string_view &word : words) {
+    const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
+    if (word_to_document_freqs_it != word_to_document_freqs_.end()) {
+      word = word_to_document_freqs_it->first;
+    }
+  }
+}
+
+const Bitmap &SearchServer::GetStatusDocuments(DocumentStatus status) const {
+  return status_to_documents_[static_cast<int>(status)];
+}
+
+bool SearchServer::IsRankedBefore(const Document &lhs, const Document &rhs) {
+  if (abs(lhs.relevance - rhs.relevance) < ERROR_MARGIN) {
+    if (lhs.rating != rhs.rating) {
+      return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+  }
+  return lhs.relevance > rhs.relevance;
+}
+
+void SearchServer::SelectPage(AutoExecutionPolicy, vector<Document> &documents, const PageRequest &page) {
+  SelectPage(execution::seq, documents, page);
+}
+
+SearchServer::QueryPostings SearchServer::ResolveWordPostings(const Query &query) const {
+  const auto find_document_freqs = [this](string_view word) -> const PostingList * {
+    const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
+    return word_to_document_freqs_it == word_to_document_freqs_.end() ? nullptr : &word_to_document_freqs_it->second;
+  };
+  QueryPostings postings;
+  postings.plus_word_freqs.reserve(query.plus_words.size());
+  transform(query.plus_words.begin(), query.plus_words.end(),
+            back_inserter(postings.plus_word_freqs), find_document_freqs);
+  postings.minus_word_freqs.reserve(query.minus_words.size());
+  transform(query.minus_words.begin(), query.minus_words.end(),
+            back_inserter(postings.minus_word_freqs), find_document_freqs);
+  return postings;
+}
+
+SearchServer::QueryPostings SearchServer::ResolvePostings(const Query &query) const {
+  QueryPostings postings = ResolveWordPostings(query);
+  ExpandPostings(query, postings);
+  return postings;
+}
+
+void SearchServer::ExpandPostings(const Query &query, QueryPostings &postings) const {
+  postings.plus_prefix_expansions.clear();
+  for (const string_view prefix : query.plus_prefixes) {
+    vector<WordExpansion> &expansions = postings.plus_prefix_expansions.emplace_back();
+    ForEachWordWithPrefix(prefix,
+                          MAX_PREFIX_EXPANSION_COUNT,
+                          [&expansions](string_view word, const PostingList &posting_list) {
+                            expansions.push_back({word, &posting_list, 0});
+                          });
+  }
+  postings.fuzzy_word_expansions.clear();
+  for (const FuzzyWord &fuzzy_word : query.fuzzy_words) {
+    vector<WordExpansion> &expansions = postings.fuzzy_word_expansions.emplace_back();
+    ForEachKeyWithinDistance(word_to_document_freqs_,
+                             fuzzy_word.data,
+                             fuzzy_word.max_distance,
+                             MAX_FUZZY_EXPANSION_COUNT,
+                             [&expansions](const auto &word_document_freqs, int distance) {
+                               expansions.push_back({word_document_freqs.first, &word_document_freqs.second, distance});
+                             });
+  }
+}
+
+SearchServer::QueryPostings SearchServer::GetWordPostings(const PreparedQuery &query) const {
+  if (query.server_ != this || query.dictionary_version_ != dictionary_version_.Get()) {
+    return ResolveWordPostings(query.query_);
+  }
+  // Words are never erased from the index and posting lists stay in place, so only the words
+  // missing at Prepare can resolve differently, and only once new words are indexed
+  QueryPostings postings = query.postings_;
+  if (query.word_count_ == word_to_document_freqs_.size()) {
+    return postings;
+  }
+  const auto resolve_missing_words = [this](const vector<string_view> &words,
+                                            vector<const PostingList *> &word_freqs) {
+    for (size_t i = 0; i < words.size(); ++i) {
+      if (!word_freqs[i]) {
+        const auto word_to_document_freqs_it = word_to_document_freqs_.find(words[i]);
+        if (word_to_document_freqs_it != word_to_document_freqs_.end()) {
+          word_freqs[i] = &word_to_document_freqs_it->second;
+        }
+      }
+    }
+  };
+  resolve_missing_words(query.query_.plus_words, postings.plus_word_freqs);
+  resolve_missing_words(query.query_.minus_words, postings.minus_word_freqs);
+  return postings;
+}
+
+SearchServer::QueryPostings SearchServer::GetPostings(const PreparedQuery &query) const {
+  QueryPostings postings = GetWordPostings(query);
+  ExpandPostings(query.query_, postings);
+  return postings;
+}
+
+size_t SearchServer::CountPlusPostings(const Query &query, const QueryPostings &postings) const {
+  size_t posting_count = 0;
+  for (const PostingList *posting_list : postings.plus_word_freqs) {
+    posting_count += posting_list ? posting_list->document_freqs.size() : 0;
+  }
+  // A phrase scans the postings of its rarest word
+  for (const Phrase &phrase : query.phrases) {
+    size_t rarest_posting_count = numeric_limits<size_t>::max();
+    for (const string_view word : phrase.words) {
+      const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
+      rarest_posting_count = min(rarest_posting_count, word_to_document_freqs_it == word_to_document_freqs_.end()
+                                                       ? 0 : word_to_document_freqs_it->second.document_freqs.size());
+    }
+    posting_count += phrase.words.empty() ? 0 : rarest_posting_count;
+  }
+  for (const auto *expansions_by_term : {&postings.plus_prefix_expansions, &postings.fuzzy_word_expansions}) {
+    for (const vector<WordExpansion> &expansions : *expansions_by_term) {
+      for (const WordExpansion &expansion : expansions) {
+        posting_count += expansion.postings->document_freqs.size();
+      }
+    }
+  }
+  return posting_count;
+}
+
+size_t SearchServer::ChooseThreadCount(const Query &query, const QueryPostings &postings) const {
+  size_t posting_count = CountPlusPostings(query, postings);
+  for (const PostingList *posting_list : postings.minus_word_freqs) {
+    posting_count += posting_list ? posting_list->document_freqs.size() : 0;
+  }
+  // Minus prefixes are not expanded ahead, they are bounded only by the documents they can reach
+  posting_count += query.minus_prefixes.size() * document_ids_.size();
+
+  const ExecutionCalibration &calibration = execution_calibration_;
+  if (posting_count < calibration.min_parallel_posting_count) {
+    return 1;
+  }
+  // Parallel loops run one task per query term, threads beyond the terms would stay idle
+  const size_t task_count = max({postings.plus_word_freqs.size(), postings.minus_word_freqs.size(),
+                                 query.phrases.size(), query.plus_prefixes.size(),
+                                 query.minus_prefixes.size(), query.fuzzy_words.size()});
+  return clamp<size_t>(posting_count / calibration.postings_per_thread,
+                       1,
+                       max<size_t>(min(calibration.max_thread_count, task_count), 1));
+}
+
+CorpusStats SearchServer::GetCorpusStats() const {
+  const double average_document_length =
+      documents_.empty() ? 0.0 : total_document_length_ * 1.0 / documents_.size();
+  return {GetDocumentCount(), document_lengths_, average_document_length};
+}
+
+bool SearchServer::DocumentContainsPhrase(const Phrase &phrase, int document_id) const {
+  vector<vector<uint32_t>> word_positions;
+  word_positions.reserve(phrase.words.size());
+  for (const string_view word : phrase.words) {
+    const auto word_to_document_positions_it = word_to_document_positions_.find(word);
+    if (word_to_document_positions_it == word_to_document_positions_.end()) {
+      return false;
+    }
+    const auto document_positions_it = word_to_document_positions_it->second.find(document_id);
+    if (document_positions_it == word_to_document_positions_it->second.end()) {
+      return false;
+    }
+    word_positions.push_back(document_positions_it->second.Decode());
+  }
+  // Start positions only grow, so each position list is walked once
+  vector<size_t> cursors(word_positions.size());
+  for (const uint32_t start : word_positions[0]) {
+    bool is_matched = true;
+    for (size_t i = 1; i < word_positions.size() && is_matched; ++i) {
+      const uint32_t expected = start + phrase.offsets[i];
+      const vector<uint32_t> &positions = word_positions[i];
+      size_t &cursor = cursors[i];
+      while (cursor < positions.size() && positions[cursor] < expected) {
+        ++cursor;
+      }
+      if (cursor == positions.size()) {
+        return false;
+      }
+      is_matched = positions[cursor] == expected;
+    }
+    if (is_matched) {
+      return true;
+    }
+  }
+  return false;
+}
+
+vector<string_view> SearchServer::FindDocumentWordsWithPrefix(int document_id,
+                                                              string_view prefix) const {
+  vector<string_view> words;
+  const auto &word_freqs = GetWordFrequencies(document_id);
+  for (auto it = word_freqs.lower_bound(prefix);
+       it != word_freqs.end() && it->first.substr(0, prefix.size()) == prefix;
+       ++it) {
+    words.push_back(it->first);
+  }
+  return words;
+}
+
+vector<string_view> SearchServer::FindDocumentWordsWithinDistance(int document_id,
+                                                                  const FuzzyWord &fuzzy_word) const {
+  vector<string_view> words;
+  ForEachKeyWithinDistance(
+      GetWordFrequencies(document_id),
+      fuzzy_word.data,
+      fuzzy_word.max_distance,
+      MAX_FUZZY_EXPANSION_COUNT,
+      [&words](const auto &word_freq, int /*distance*/) {
+        words.push_back(word_freq.first);
+      });
+  return words;
+}
+
+uint64_t SearchServer::NextDictionaryVersion() {
+  static atomic<uint64_t> last_version = 0;
+  return ++last_version;
 }
 
 bool SearchServer::IsValidWord(string_view word) {
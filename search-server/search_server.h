@@ -3,7 +3,19 @@
 #include "document.h"
 #include "string_processing.h"
 #include "log_duration.h"
-#include "concurrent_map.h"
+#include "concurrent_hash_map.h"
+#include "bitmap.h"
+#include "document_column.h"
+#include "filter_expression.h"
+#include "position_list.h"
+#include "levenshtein_automaton.h"
+#include "scoring_model.h"
+#include "term_freq.h"
+#include "query_deadline.h"
+#include "stop_word_set.h"
+#include "text_analyzer.h"
+#include "trace.h"
+#include "paginator.h"
 
 #include <map>
 #include <set>
@@ -13,6 +25,13 @@
 #include <iostream>
 #include <execution>
 #include <numeric>
+#include <cmath>
+#include <optional>
+#include <memory>
+#include <limits>
+#include <thread>
+
+#include <tbb/task_arena.h>
 
 using namespace std::string_literals;
 
@@ -20,8 +39,78 @@ using namespace std::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// Plus prefix word "ca*" is expanded to at most this many indexed words
+const int MAX_PREFIX_EXPANSION_COUNT = 1000;
+
+// Fuzzy word "cat~" or "cat~2" matches at most this many indexed words within the edit distance
+const int MAX_FUZZY_EXPANSION_COUNT = 100;
+
+const int MAX_FUZZY_DISTANCE = 2;
+
+// Impact index quantizes TF-IDF scores to 1 .. MAX_IMPACT, 0 only for zero scores
+const int MAX_IMPACT = 255;
+
+// Results are ranked by relevance, then rating, then id. A page is either an offset into them
+// or the results ranked after a cursor, the last document of the previous page
+struct PageRequest {
+  size_t offset = 0;
+  size_t limit = MAX_RESULT_DOCUMENT_COUNT;
+  std::optional<Document> after;
+};
+
+// Execution policy for FindTopDocuments: the query cost is estimated from its posting lists
+// and the query runs sequentially, or in parallel on as many threads as the cost pays for
+struct AutoExecutionPolicy {
+};
+
+inline constexpr AutoExecutionPolicy auto_execution;
+
+// Execution policy for FindTopDocuments: the document id space is split into ranges scored on
+// threads of their own, each with all query terms, and only the top of every range is merged.
+// Results are the same as with execution::seq
+struct PartitionedExecutionPolicy {
+  // 0 for one partition per hardware thread
+  size_t partition_count = 0;
+};
+
+inline constexpr PartitionedExecutionPolicy partitioned_execution;
+
+// Thresholds of AutoExecutionPolicy, SearchServer::CalibrateExecution measures them on the index
+struct ExecutionCalibration {
+  // Queries over fewer postings run sequentially
+  size_t min_parallel_posting_count = 100'000;
+  // Every thread beyond the first takes this many more postings
+  size_t postings_per_thread = 50'000;
+  size_t max_thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+};
+
+// Non-stop words of a document in order with their positions among all its words.
+// Words are views into the document text, or into normalized_text if an analyzer is set
+struct TokenizedDocument {
+  std::vector<std::string_view> words;
+  std::vector<uint32_t> positions;
+  std::shared_ptr<const std::string> normalized_text;
+};
+
+// Result of MatchDocuments in flat buffers. Matched words of the i-th requested document are
+// words[offsets[i]] .. words[offsets[i + 1] - 1], its status is statuses[i]
+struct DocumentMatches {
+  std::vector<std::string_view> words;
+  std::vector<size_t> offsets;
+  std::vector<DocumentStatus> statuses;
+};
+
+// Result of a query run under a QueryDeadline. A truncated result holds the documents scored
+// before the deadline expired, their relevance may lack the query words not reached
+struct TopDocuments {
+  std::vector<Document> documents;
+  bool is_truncated = false;
+};
+
 class SearchServer {
  public:
+  class PreparedQuery;
+
   template<typename StringContainer>
   explicit SearchServer(const StringContainer &stop_words);
 
@@ -29,33 +118,107 @@ class SearchServer {
 
   explicit SearchServer(std::string_view stop_words_text);
 
+  // Stores word positions of documents added afterwards, required by "quoted phrase" queries
+  void EnablePositionalIndex();
+
+  // Normalizes the stop words, the documents and every query. Must be set before adding documents
+  void SetTextAnalyzer(const TextAnalyzer &analyzer);
+
+  // Relevance of a fuzzy match is multiplied by penalty once per edit, penalty is in (0, 1]
+  void SetFuzzyMatchPenalty(double penalty);
+
   void AddDocument(int document_id, std::string_view document, DocumentStatus status,
                    const std::vector<int> &ratings);
 
+  // Tokenization stage of AddDocument. Only reads the stop words, so it is safe to run
+  // concurrently with AddDocument
+  TokenizedDocument TokenizeDocument(std::string_view document) const;
+
+  // Document text must stay alive until the call returns
+  void AddDocument(int document_id, const TokenizedDocument &document, DocumentStatus status,
+                   const std::vector<int> &ratings);
+
   template<typename DocumentPredicate>
   std::vector<Document> FindTopDocuments(std::string_view raw_query,
                                          DocumentPredicate document_predicate) const;
 
-  template<typename DocumentPredicate, typename ExecutionPolicy>
+  // Overloads taking a policy are scored with the ScoringModel from scoring_model.h,
+  // e.g. FindTopDocuments<Bm25>(std::execution::seq, raw_query)
+  template<typename ScoringModel = TfIdf, typename DocumentPredicate, typename ExecutionPolicy>
   std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
                                          std::string_view raw_query,
-                                         DocumentPredicate document_predicate) const;
+                                         DocumentPredicate document_predicate,
+                                         const PageRequest &page = {}) const;
 
   std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
 
-  template<typename ExecutionPolicy>
+  template<typename ScoringModel = TfIdf, typename ExecutionPolicy>
+  std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                         std::string_view raw_query,
+                                         DocumentStatus status,
+                                         const PageRequest &page = {}) const;
+
+  // Scoring stops at the first block of postings reached after the deadline expires. Minus
+  // words are still applied, so a truncated result never holds an excluded document
+  template<typename ScoringModel = TfIdf, typename ExecutionPolicy>
+  TopDocuments FindTopDocuments(ExecutionPolicy &&policy,
+                                std::string_view raw_query,
+                                DocumentStatus status,
+                                const PageRequest &page,
+                                const QueryDeadline &deadline) const;
+
+  // Filter is evaluated once into a candidate bitmap, prefer it over a lambda
+  std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                         const FilterExpression &filter) const;
+
+  template<typename ScoringModel = TfIdf, typename ExecutionPolicy>
   std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
                                          std::string_view raw_query,
-                                         DocumentStatus status) const;
+                                         const FilterExpression &filter,
+                                         const PageRequest &page = {}) const;
 
   std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
-  template<typename ExecutionPolicy>
+  // Validates and parses the query once, for queries that are run many times
+  PreparedQuery Prepare(std::string_view raw_query) const;
+
+  template<typename ScoringModel = TfIdf, typename ExecutionPolicy>
+  std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
+                                         const PreparedQuery &query,
+                                         DocumentStatus status = DocumentStatus::ACTUAL,
+                                         const PageRequest &page = {}) const;
+
+  template<typename ScoringModel = TfIdf, typename ExecutionPolicy>
   std::vector<Document> FindTopDocuments(ExecutionPolicy &&policy,
                                          std::string_view raw_query) const;
 
+  // Runs sequential and parallel queries of growing posting cost over the index's own words
+  // and sets the thresholds of auto_execution from where parallel starts to win
+  ExecutionCalibration CalibrateExecution();
+
+  void SetExecutionCalibration(const ExecutionCalibration &calibration);
+
+  const ExecutionCalibration &GetExecutionCalibration() const;
+
+  // Threads auto_execution runs the query on, 1 if it runs sequentially
+  size_t ChooseThreadCount(std::string_view raw_query) const;
+
+  // Snapshots TF-IDF scores into posting lists ordered by quantized impact. Documents added
+  // later are not in the snapshot, removed ones are skipped; rebuild after bulk changes
+  void BuildImpactIndex();
+
+  // Approximate top documents from the impact index for plus and minus words. High impact
+  // postings of all query words are scored first, traversal stops once the top can no
+  // longer change or posting_budget postings are spent. The top is then rescored exactly
+  std::vector<Document> FindTopDocumentsByImpact(
+      std::string_view raw_query,
+      DocumentStatus status = DocumentStatus::ACTUAL,
+      size_t posting_budget = std::numeric_limits<size_t>::max()) const;
+
   int GetDocumentCount() const;
 
+  size_t GetPositionalIndexByteSize() const;
+
   std::tuple<std::vector<std::string_view>,
              DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
 
@@ -69,17 +232,57 @@ class SearchServer {
       std::string_view raw_query,
       int document_id) const;
 
-  const std::map<std::string_view, double> &GetWordFrequencies(int document_id) const;
+  std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const PreparedQuery &query,
+                                                                          int document_id) const;
+
+  // Plus words are checked until the deadline expires, the flag is set if some were not
+  std::tuple<std::vector<std::string_view>, DocumentStatus, bool> MatchDocument(
+      std::string_view raw_query,
+      int document_id,
+      const QueryDeadline &deadline) const;
+
+  // Same as MatchDocument for every document, but the query is parsed once and each of its
+  // words is intersected with all the documents at once
+  DocumentMatches MatchDocuments(std::string_view raw_query,
+                                 const std::vector<int> &document_ids) const;
+
+  template<typename ExecutionPolicy>
+  DocumentMatches MatchDocuments(ExecutionPolicy &&policy,
+                                 std::string_view raw_query,
+                                 const std::vector<int> &document_ids) const;
+
+  const std::map<std::string_view, TermFreq> &GetWordFrequencies(int document_id) const;
+
+  // Moves the document to another status partition without reindexing its words
+  void SetDocumentStatus(int document_id, DocumentStatus status);
 
+  // Removed document leaves results at once, its postings stay behind a tombstone until
+  // the next compaction and still count in document frequencies
   void RemoveDocument(int document_id);
 
   template<typename ExecutionPolicy>
   void RemoveDocument(ExecutionPolicy &&policy, int document_id);
 
+  // Postings are compacted once removed documents make up garbage_ratio of all documents
+  // still in the index, ratio is in (0, 1]
+  void SetCompactionThreshold(double garbage_ratio);
+
+  // Drops the postings of every removed document in one sweep over the index
+  void CompactPostings();
+
+  template<typename ExecutionPolicy>
+  void CompactPostings(ExecutionPolicy &&policy);
+
   std::set<int>::const_iterator begin() const;
 
   std::set<int>::const_iterator end() const;
 
+  // Result order: relevance descending with ERROR_MARGIN, then rating descending, then id
+  static bool IsRankedBefore(const Document &lhs, const Document &rhs);
+
+  // Text without control characters
+  static bool IsValidWord(std::string_view word);
+
  private:
   struct DocumentData {
     int rating;
@@ -90,46 +293,360 @@ class SearchServer {
     std::string_view data;
     bool is_minus;
     bool is_stop;
+    bool is_prefix;
+    int max_distance;
+  };
+
+  struct FuzzyWord {
+    std::string_view data;
+    int max_distance;
+    bool is_minus;
+  };
+
+  struct Phrase {
+    std::vector<std::string_view> words;
+    // Positions relative to the first word, stop words keep their places
+    std::vector<uint32_t> offsets;
   };
 
   struct Query {
     std::vector<std::string_view> plus_words;
     std::vector<std::string_view> minus_words;
+    std::vector<Phrase> phrases;
+    // Prefixes are stored without the trailing '*'
+    std::vector<std::string_view> plus_prefixes;
+    std::vector<std::string_view> minus_prefixes;
+    std::vector<FuzzyWord> fuzzy_words;
+    // Normalized query text, the words are views into it when an analyzer is set. Matched
+    // words are mapped to the index keys before they are returned, so they outlive the query
+    std::shared_ptr<const std::string> normalized_text;
   };
 
-  const std::set<std::string, std::less<>> stop_words_;
-  std::map<std::string, std::map<int, double>, std::less<>> word_to_document_freqs_;
-  std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
+  struct ImpactPosting {
+    int document_id;
+    uint8_t impact;
+  };
+
+  // Deadline of one query shared by the threads running it, remembers that it expired
+  class DeadlineCheck {
+   public:
+    explicit DeadlineCheck(const QueryDeadline &deadline) : deadline_(deadline) {
+    }
+
+    // Polls the deadline only at every DEADLINE_CHECK_INTERVAL-th posting of a list
+    bool IsExpiredAt(size_t posting_index) {
+      return posting_index % DEADLINE_CHECK_INTERVAL == 0 && IsExpired();
+    }
+
+    bool IsExpired() {
+      if (has_expired_.load(std::memory_order_relaxed)) {
+        return true;
+      }
+      if (deadline_.IsExpired()) {
+        has_expired_.store(true, std::memory_order_relaxed);
+        return true;
+      }
+      return false;
+    }
+
+    bool HasExpired() const {
+      return has_expired_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    const QueryDeadline deadline_;
+    std::atomic<bool> has_expired_ = false;
+  };
+
+  // Removed documents keep their postings until the next compaction, they are counted next to
+  // the list so that idf only counts live documents
+  struct PostingList {
+    std::map<int, TermFreq> document_freqs;
+    size_t removed_document_count = 0;
+
+    size_t GetDocumentFreq() const {
+      return document_freqs.size() - removed_document_count;
+    }
+  };
+
+  // Words of a document and the posting lists holding them in word order, so that removal
+  // reaches the lists without a lookup. A copy drops the pointers, they belong to the source index
+  struct DocumentWords {
+    std::map<std::string_view, TermFreq> word_freqs;
+    std::vector<PostingList *> postings;
+
+    DocumentWords() = default;
+
+    DocumentWords(const DocumentWords &other)
+        : word_freqs(other.word_freqs) {
+    }
+
+    DocumentWords(DocumentWords &&) = default;
+
+    DocumentWords &operator=(const DocumentWords &other) {
+      word_freqs = other.word_freqs;
+      postings.clear();
+      return *this;
+    }
+
+    DocumentWords &operator=(DocumentWords &&) = default;
+  };
+
+  // Indexed word a plus prefix or a fuzzy word expands to
+  struct WordExpansion {
+    std::string_view word;
+    const PostingList *postings;
+    // Edit distance from the fuzzy word, zero for prefixes
+    int distance;
+  };
+
+  // Postings of the plus and minus words in query order, nullptr for words not in the index.
+  // Expansions of plus prefixes and fuzzy words follow their query order as well, they are
+  // resolved for scoring only
+  struct QueryPostings {
+    std::vector<const PostingList *> plus_word_freqs;
+    std::vector<const PostingList *> minus_word_freqs;
+    std::vector<std::vector<WordExpansion>> plus_prefix_expansions;
+    std::vector<std::vector<WordExpansion>> fuzzy_word_expansions;
+  };
+
+  StopWordSet stop_words_;
+  TextAnalyzer text_analyzer_;
+  std::map<std::string, PostingList, std::less<>> word_to_document_freqs_;
+  std::map<int, DocumentWords> document_to_word_freqs_;
   std::map<int, DocumentData> documents_;
   std::set<int> document_ids_;
+  // Per-status document bitmaps, status-only queries filter postings with them
+  std::vector<Bitmap> status_to_documents_ = std::vector<Bitmap>(DOCUMENT_STATUS_COUNT);
+  // Rating column keyed by document id, scanned by filter expressions
+  DocumentColumn document_ratings_;
+  // Non-stop word count column keyed by document id, used for length normalization
+  DocumentColumn document_lengths_;
+  size_t total_document_length_ = 0;
+  bool store_positions_ = false;
+  std::map<std::string, std::map<int, PositionList>, std::less<>> word_to_document_positions_;
+  double fuzzy_match_penalty_ = 0.5;
+  ExecutionCalibration execution_calibration_;
+  // Postings sorted by impact descending, then by id
+  std::map<std::string, std::vector<ImpactPosting>, std::less<>> word_to_impact_postings_;
+  // Score of a unit of impact
+  double impact_scale_ = 0;
+  bool has_impact_index_ = false;
+  // Documents removed since the last compaction
+  Bitmap removed_documents_;
+  size_t removed_document_count_ = 0;
+  double compaction_garbage_ratio_ = 0.2;
+  // Unique across all servers, renewed whenever a server is copied, moved or assigned, so that
+  // queries prepared before never take the postings of the new contents for their own
+  class DictionaryVersion {
+   public:
+    DictionaryVersion() = default;
+
+    DictionaryVersion(const DictionaryVersion &) {
+    }
+
+    DictionaryVersion(DictionaryVersion &&other) noexcept {
+      other.Renew();
+    }
+
+    DictionaryVersion &operator=(const DictionaryVersion &) {
+      Renew();
+      return *this;
+    }
+
+    DictionaryVersion &operator=(DictionaryVersion &&other) noexcept {
+      Renew();
+      other.Renew();
+      return *this;
+    }
+
+    void Renew() {
+      value_ = NextDictionaryVersion();
+    }
+
+    uint64_t Get() const {
+      return value_;
+    }
+
+   private:
+    uint64_t value_ = NextDictionaryVersion();
+  };
+
+  DictionaryVersion dictionary_version_;
 
   bool IsStopWord(std::string_view word) const;
 
-  std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+  // Drops the postings of a single removed document, its id is about to be reused
+  void PurgeRemovedDocument(int document_id);
+
+  // Posting lists of the document's words, relinks every document first after a copy
+  const std::vector<PostingList *> &GetDocumentPostings(DocumentWords &document_words);
+
+  void LinkDocumentPostings();
 
   QueryWord ParseQueryWord(std::string_view text) const;
 
+  Phrase ParsePhrase(std::string_view text) const;
+
   Query ParseQueryUnique(std::string_view raw_query) const;
 
   Query ParseQuery(std::string_view raw_query) const;
 
   Query GetValidParsedQuery(std::string_view raw_query, bool uniqueWords = true) const;
 
-  // Existence required
-  double ComputeWordInverseDocumentFreq(std::string_view word) const;
+  // Postings of the plus and minus words only, enough for matching a single document
+  QueryPostings ResolveWordPostings(const Query &query) const;
 
-  template<typename DocumentPredicate>
-  std::vector<Document> FindAllDocuments(const Query &query,
-                                         DocumentPredicate document_predicate) const;
+  // Word postings plus the expansions of plus prefixes and fuzzy words, each dictionary walk
+  // is done once per query however many partitions score it
+  QueryPostings ResolvePostings(const Query &query) const;
+
+  void ExpandPostings(const Query &query, QueryPostings &postings) const;
+
+  size_t ChooseThreadCount(const Query &query, const QueryPostings &postings) const;
+
+  // Postings the plus terms can score, phrases counting their rarest word and expansions their
+  // expanded words. Bounds the number of documents the query matches
+  size_t CountPlusPostings(const Query &query, const QueryPostings &postings) const;
+
+  // Word postings resolved by Prepare while they are still valid for this server, else
+  // resolved anew
+  QueryPostings GetWordPostings(const PreparedQuery &query) const;
 
-  template<typename DocumentPredicate, typename ExecutionPolicy>
+  QueryPostings GetPostings(const PreparedQuery &query) const;
+
+  std::tuple<std::vector<std::string_view>, DocumentStatus, bool> MatchQuery(const Query &query,
+                                                                             const QueryPostings &postings,
+                                                                             int document_id,
+                                                                             const QueryDeadline &deadline) const;
+
+  CorpusStats GetCorpusStats() const;
+
+  bool DocumentContainsPhrase(const Phrase &phrase, int document_id) const;
+
+  // Turns views into a normalized query text into views into the index keys, words of a
+  // query parsed without an analyzer are views into the caller's text and are kept
+  void PointIntoIndex(const Query &query, std::vector<std::string_view> &words) const;
+
+  std::vector<std::string_view> FindDocumentWordsWithPrefix(int document_id,
+                                                          std::string_view prefix) const;
+
+  std::vector<std::string_view> FindDocumentWordsWithinDistance(int document_id,
+                                                              const FuzzyWord &fuzzy_word) const;
+
+  // Calls callback(word, posting_list) for indexed words starting with prefix in word order,
+  // stops after max_word_count words with postings
+  template<typename Callback>
+  void ForEachWordWithPrefix(std::string_view prefix, size_t max_word_count, Callback callback) const;
+
+  const Bitmap &GetStatusDocuments(DocumentStatus status) const;
+
+  // Calls callback(index) for every (id, index) of sorted_documents whose id has a posting.
+  // Leapfrogs: the posting tree is searched for the next document, the documents are galloped
+  // to the next posting, so the cost follows the shorter side
+  template<typename Callback>
+  static void IntersectPostings(const std::map<int, TermFreq> &document_freqs,
+                                const std::vector<std::pair<int, size_t>> &sorted_documents,
+                                Callback callback);
+
+  // Documents with ids first .. last
+  struct DocumentRange {
+    int first = 0;
+    int last = std::numeric_limits<int>::max();
+  };
+
+  // Relevance of the documents of one partition, scored on a single thread
+  struct PartitionRelevance {
+    std::map<int, double> document_to_relevance;
+
+    void FetchAdd(int document_id, double relevance) {
+      document_to_relevance[document_id] += relevance;
+    }
+
+    void Erase(int document_id) {
+      document_to_relevance.erase(document_id);
+    }
+  };
+
+  template<typename DocumentFreqs>
+  static IteratorRange<typename DocumentFreqs::const_iterator> PostingsInRange(const DocumentFreqs &document_freqs,
+                                                                               DocumentRange range);
+
+  // Adds the relevance of the documents in range to the accumulator, which has FetchAdd and
+  // Erase like ConcurrentHashMap. Terms are scored in the same order on every path, so sums of
+  // a document come out the same whatever the policy or partitioning
+  template<typename ScoringModel, typename DocumentFilter, typename ExecutionPolicy, typename RelevanceAccumulator>
+  void ScoreDocuments(ExecutionPolicy &&policy,
+                      const Query &query,
+                      const QueryPostings &postings,
+                      DocumentFilter document_filter,
+                      DeadlineCheck &deadline_check,
+                      DocumentRange range,
+                      RelevanceAccumulator &relevance_accumulator) const;
+
+  // DocumentFilter is called with a document id only. Scoring loops stop once deadline_check
+  // expires, exclusions always run to the end
+  template<typename ScoringModel, typename DocumentFilter, typename ExecutionPolicy>
   std::vector<Document> FindAllDocuments(ExecutionPolicy &&policy,
                                          const Query &query,
-                                         DocumentPredicate document_predicate) const;
+                                         const QueryPostings &postings,
+                                         DocumentFilter document_filter,
+                                         DeadlineCheck &deadline_check) const;
+
+  template<typename ScoringModel, typename DocumentFilter>
+  std::vector<Document> FindAllDocuments(AutoExecutionPolicy policy,
+                                         const Query &query,
+                                         const QueryPostings &postings,
+                                         DocumentFilter document_filter,
+                                         DeadlineCheck &deadline_check) const;
+
+  // Requested page of the matches
+  template<typename ScoringModel, typename DocumentFilter, typename ExecutionPolicy>
+  std::vector<Document> FindPage(ExecutionPolicy &&policy,
+                                 const Query &query,
+                                 const QueryPostings &postings,
+                                 DocumentFilter document_filter,
+                                 const PageRequest &page,
+                                 DeadlineCheck &deadline_check) const;
+
+  template<typename ScoringModel, typename DocumentFilter>
+  std::vector<Document> FindPage(PartitionedExecutionPolicy policy,
+                                 const Query &query,
+                                 const QueryPostings &postings,
+                                 DocumentFilter document_filter,
+                                 const PageRequest &page,
+                                 DeadlineCheck &deadline_check) const;
+
+  // Keeps only the requested page, partially sorting offset + limit documents at most
+  template<typename ExecutionPolicy>
+  static void SelectPage(ExecutionPolicy &&policy,
+                         std::vector<Document> &documents,
+                         const PageRequest &page);
+
+  // Selecting a page is linear in the matches, too little work to hand off to threads
+  static void SelectPage(AutoExecutionPolicy policy,
+                         std::vector<Document> &documents,
+                         const PageRequest &page);
 
   static int ComputeAverageRating(const std::vector<int> &ratings);
 
-  static bool IsValidWord(std::string_view word);
+  static uint64_t NextDictionaryVersion();
+};
+
+// Plus and minus words keep the postings resolved by Prepare, words not indexed at Prepare are
+// looked up again on every call once new words are indexed, until the query is prepared again
+class SearchServer::PreparedQuery {
+ private:
+  friend class SearchServer;
+
+  // Query words are views into the text, shared so that copies of the query stay valid
+  std::shared_ptr<const std::string> text_;
+  Query query_;
+  QueryPostings postings_;
+  const SearchServer *server_ = nullptr;
+  uint64_t dictionary_version_ = 0;
+  // Size of the dictionary at Prepare, it only grows
+  size_t word_count_ = 0;
 };
 
 template<typename StringContainer>
@@ -146,56 +663,100 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
   return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
 }
 
-template<typename DocumentPredicate, typename ExecutionPolicy>
+template<typename ScoringModel, typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
                                                      std::string_view raw_query,
-                                                     DocumentPredicate document_predicate) const {
+                                                     DocumentPredicate document_predicate,
+                                                     const PageRequest &page) const {
   const Query query = GetValidParsedQuery(raw_query);
 
-  auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-  sort(
+  DeadlineCheck deadline_check{QueryDeadline()};
+  return FindPage<ScoringModel>(
       policy,
-      matched_documents.begin(),
-      matched_documents.end(),
-      [](const Document &lhs, const Document &rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < ERROR_MARGIN) {
-          return lhs.rating > rhs.rating;
-        } else {
-          return lhs.relevance > rhs.relevance;
-        }
-      });
-  if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-    matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+      query,
+      ResolvePostings(query),
+      [this, &document_predicate](int document_id) {
+        const auto &document_data = documents_.at(document_id);
+        return document_predicate(document_id, document_data.status, document_data.rating);
+      },
+      page,
+      deadline_check);
+}
+
+template<typename ExecutionPolicy>
+void SearchServer::SelectPage(ExecutionPolicy &&policy,
+                              std::vector<Document> &documents,
+                              const PageRequest &page) {
+  TRACE_SCOPE("SelectPage");
+  if (page.after) {
+    documents.erase(
+        std::remove_if(
+            policy,
+            documents.begin(),
+            documents.end(),
+            [&page](const Document &document) {
+              return !IsRankedBefore(*page.after, document);
+            }),
+        documents.end());
   }
-  return matched_documents;
+  const size_t page_begin = std::min(page.offset, documents.size());
+  const size_t page_end = page_begin + std::min(page.limit, documents.size() - page_begin);
+  std::partial_sort(
+      policy,
+      documents.begin(),
+      documents.begin() + page_end,
+      documents.end(),
+      IsRankedBefore);
+  documents.resize(page_end);
+  documents.erase(documents.begin(), documents.begin() + page_begin);
 }
 
-template<typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query &query,
-                                                     DocumentPredicate document_predicate) const {
-  return FindAllDocuments(std::execution::seq, query, document_predicate);
+template<typename DocumentFreqs>
+IteratorRange<typename DocumentFreqs::const_iterator> SearchServer::PostingsInRange(const DocumentFreqs &document_freqs,
+                                                                                    DocumentRange range) {
+  // Whole lists are taken without a lookup
+  return IteratorRange(
+      range.first == 0 ? document_freqs.begin() : document_freqs.lower_bound(range.first),
+      range.last == std::numeric_limits<int>::max() ? document_freqs.end() : document_freqs.upper_bound(range.last));
 }
 
-template<typename DocumentPredicate, typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy &&policy,
-                                                     const Query &query,
-                                                     DocumentPredicate document_predicate) const {
-  ConcurrentMap<int, double>
-      concurrent_map_document_to_relevance(std::thread::hardware_concurrency());
+template<typename ScoringModel, typename DocumentFilter, typename ExecutionPolicy, typename RelevanceAccumulator>
+void SearchServer::ScoreDocuments(ExecutionPolicy &&policy,
+                                  const Query &query,
+                                  const QueryPostings &postings,
+                                  DocumentFilter document_filter,
+                                  DeadlineCheck &deadline_check,
+                                  DocumentRange range,
+                                  RelevanceAccumulator &relevance_accumulator) const {
+  // Removed documents keep their postings until the next compaction
+  const auto is_candidate = [this, &document_filter](int document_id) {
+    return !removed_documents_.Test(document_id) && document_filter(document_id);
+  };
+  const ScoringModel scoring_model(GetCorpusStats());
+  // Weights are resolved up front, postings.plus_word_freqs is aligned with query.plus_words
+  std::vector<std::pair<const std::map<int, TermFreq> *, double>> plus_word_postings;
+  plus_word_postings.reserve(postings.plus_word_freqs.size());
+  for (const PostingList *posting_list : postings.plus_word_freqs) {
+    plus_word_postings.emplace_back(
+        posting_list ? &posting_list->document_freqs : nullptr,
+        posting_list ? scoring_model.ComputeWordWeight(posting_list->GetDocumentFreq()) : 0.0);
+  }
   std::for_each(
       policy,
-      query.plus_words.begin(),
-      query.plus_words.end(),
-      [this, document_predicate, &concurrent_map_document_to_relevance](std::string_view word) {
-        const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
-        if (word_to_document_freqs_it != word_to_document_freqs_.end()) {
-          const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-          for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::string(word))) {
-            const auto &document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-              concurrent_map_document_to_relevance[document_id].ref_to_value +=
-                  term_freq * inverse_document_freq;
+      plus_word_postings.begin(),
+      plus_word_postings.end(),
+      [&scoring_model, is_candidate, &deadline_check, range, &relevance_accumulator](const auto &word_postings) {
+        TRACE_SCOPE("FindAllDocuments plus word");
+        const auto [document_freqs, word_weight] = word_postings;
+        if (document_freqs) {
+          size_t posting_index = 0;
+          for (const auto [document_id, term_freq] : PostingsInRange(*document_freqs, range)) {
+            if (deadline_check.IsExpiredAt(posting_index++)) {
+              return;
+            }
+            if (is_candidate(document_id)) {
+              relevance_accumulator.FetchAdd(
+                  document_id, scoring_model.Score(word_weight, term_freq, document_id));
             }
           }
         }
@@ -204,70 +765,524 @@ std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy &&policy,
 
   std::for_each(
       policy,
-      query.minus_words.begin(),
-      query.minus_words.end(),
-      [this, &concurrent_map_document_to_relevance](std::string_view word) {
-        const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
-        if (word_to_document_freqs_it != word_to_document_freqs_.end()) {
-          for (const auto [document_id, _] : word_to_document_freqs_.at(std::string(word))) {
-            concurrent_map_document_to_relevance.erase(document_id);
+      query.phrases.begin(),
+      query.phrases.end(),
+      [this, &scoring_model, is_candidate, &deadline_check, range, &relevance_accumulator](const Phrase &phrase) {
+        TRACE_SCOPE("FindAllDocuments phrase");
+        // Candidates are taken from the rarest word of the phrase
+        const std::map<int, TermFreq> *rarest_word_freqs = nullptr;
+        for (const std::string_view word : phrase.words) {
+          const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
+          if (word_to_document_freqs_it == word_to_document_freqs_.end()) {
+            return;
+          }
+          const auto &document_freqs = word_to_document_freqs_it->second.document_freqs;
+          if (!rarest_word_freqs || document_freqs.size() < rarest_word_freqs->size()) {
+            rarest_word_freqs = &document_freqs;
+          }
+        }
+        size_t posting_index = 0;
+        for (const auto [document_id, _] : PostingsInRange(*rarest_word_freqs, range)) {
+          if (deadline_check.IsExpiredAt(posting_index++)) {
+            return;
+          }
+          if (!is_candidate(document_id) || !DocumentContainsPhrase(phrase, document_id)) {
+            continue;
+          }
+          double relevance = 0;
+          for (const std::string_view word : phrase.words) {
+            const PostingList &posting_list = word_to_document_freqs_.find(word)->second;
+            relevance += scoring_model.Score(scoring_model.ComputeWordWeight(posting_list.GetDocumentFreq()),
+                                             posting_list.document_freqs.at(document_id),
+                                             document_id);
           }
+          relevance_accumulator.FetchAdd(document_id, relevance);
         }
       }
   );
 
-  auto document_to_relevance = concurrent_map_document_to_relevance.BuildOrdinaryMap();
+  // Expanded postings are merged locally, so each document touches the shared map once
+  const auto score_expansions = [this, &scoring_model, is_candidate, &deadline_check, range, &relevance_accumulator](
+      const std::vector<WordExpansion> &expansions, double distance_penalty) {
+    std::map<int, double> document_to_relevance;
+    for (const WordExpansion &expansion : expansions) {
+      const auto &document_freqs = expansion.postings->document_freqs;
+      if (document_freqs.empty()) {
+        continue;
+      }
+      const double word_weight = scoring_model.ComputeWordWeight(expansion.postings->GetDocumentFreq())
+          * std::pow(distance_penalty, expansion.distance);
+      size_t posting_index = 0;
+      for (const auto [document_id, term_freq] : PostingsInRange(document_freqs, range)) {
+        if (deadline_check.IsExpiredAt(posting_index++)) {
+          break;
+        }
+        document_to_relevance[document_id] += scoring_model.Score(word_weight, term_freq, document_id);
+      }
+    }
+    for (const auto [document_id, relevance] : document_to_relevance) {
+      if (is_candidate(document_id)) {
+        relevance_accumulator.FetchAdd(document_id, relevance);
+      }
+    }
+  };
+
+  std::for_each(
+      policy,
+      postings.plus_prefix_expansions.begin(),
+      postings.plus_prefix_expansions.end(),
+      [&score_expansions](const std::vector<WordExpansion> &expansions) {
+        TRACE_SCOPE("FindAllDocuments plus prefix");
+        score_expansions(expansions, 1.0);
+      }
+  );
+
+  std::for_each(
+      policy,
+      postings.fuzzy_word_expansions.begin(),
+      postings.fuzzy_word_expansions.end(),
+      [this, &score_expansions](const std::vector<WordExpansion> &expansions) {
+        TRACE_SCOPE("FindAllDocuments fuzzy word");
+        score_expansions(expansions, fuzzy_match_penalty_);
+      }
+  );
+
+  std::for_each(
+      policy,
+      query.minus_prefixes.begin(),
+      query.minus_prefixes.end(),
+      [this, range, &relevance_accumulator](std::string_view prefix) {
+        TRACE_SCOPE("FindAllDocuments minus prefix");
+        ForEachWordWithPrefix(
+            prefix,
+            word_to_document_freqs_.size(),
+            [range, &relevance_accumulator](std::string_view /*word*/, const PostingList &posting_list) {
+              for (const auto [document_id, _] : PostingsInRange(posting_list.document_freqs, range)) {
+                relevance_accumulator.Erase(document_id);
+              }
+            });
+      }
+  );
+
+  std::for_each(
+      policy,
+      postings.minus_word_freqs.begin(),
+      postings.minus_word_freqs.end(),
+      [range, &relevance_accumulator](const PostingList *posting_list) {
+        TRACE_SCOPE("FindAllDocuments minus word");
+        if (posting_list) {
+          for (const auto [document_id, _] : PostingsInRange(posting_list->document_freqs, range)) {
+            relevance_accumulator.Erase(document_id);
+          }
+        }
+      }
+  );
+}
+
+template<typename ScoringModel, typename DocumentFilter, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy &&policy,
+                                                     const Query &query,
+                                                     const QueryPostings &postings,
+                                                     DocumentFilter document_filter,
+                                                     DeadlineCheck &deadline_check) const {
+  // Only live documents are added, and only those the plus terms have postings for
+  const size_t max_match_count = std::min(document_ids_.size(), CountPlusPostings(query, postings));
+  ConcurrentHashMap<int, double> concurrent_map_document_to_relevance(max_match_count);
+  ScoreDocuments<ScoringModel>(policy, query, postings, document_filter, deadline_check, DocumentRange(),
+                               concurrent_map_document_to_relevance);
+
+  const auto document_to_relevance = concurrent_map_document_to_relevance.Drain(policy);
 
   std::vector<Document> matched_documents;
   matched_documents.reserve(document_to_relevance.size());
-  for (const auto [document_id, relevance] : document_to_relevance) {
+  for (const auto &[document_id, relevance] : document_to_relevance) {
     matched_documents.push_back(
         {document_id, relevance, documents_.at(document_id).rating});
   }
   return matched_documents;
 }
 
-template<typename ExecutionPolicy>
+template<typename ScoringModel, typename DocumentFilter, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindPage(ExecutionPolicy &&policy,
+                                             const Query &query,
+                                             const QueryPostings &postings,
+                                             DocumentFilter document_filter,
+                                             const PageRequest &page,
+                                             DeadlineCheck &deadline_check) const {
+  auto matched_documents = FindAllDocuments<ScoringModel>(policy, query, postings, document_filter, deadline_check);
+  SelectPage(policy, matched_documents, page);
+  return matched_documents;
+}
+
+template<typename ScoringModel, typename DocumentFilter>
+std::vector<Document> SearchServer::FindPage(PartitionedExecutionPolicy policy,
+                                             const Query &query,
+                                             const QueryPostings &postings,
+                                             DocumentFilter document_filter,
+                                             const PageRequest &page,
+                                             DeadlineCheck &deadline_check) const {
+  if (document_ids_.empty()) {
+    return {};
+  }
+  const int64_t id_count = int64_t{*document_ids_.rbegin()} + 1;
+  const int64_t partition_count = std::min<int64_t>(
+      policy.partition_count ? policy.partition_count : std::max(std::thread::hardware_concurrency(), 1u),
+      id_count);
+  const int64_t partition_width = (id_count + partition_count - 1) / partition_count;
+  // A document within the first offset + limit of all matches is within them in its partition
+  PageRequest partition_page = page;
+  partition_page.offset = 0;
+  partition_page.limit = page.offset + std::min(page.limit, std::numeric_limits<size_t>::max() - page.offset);
+
+  std::vector<std::vector<Document>> partition_documents(partition_count);
+  std::vector<int64_t> partitions(partition_count);
+  std::iota(partitions.begin(), partitions.end(), 0);
+  std::for_each(
+      std::execution::par,
+      partitions.begin(),
+      partitions.end(),
+      [&](int64_t partition) {
+        TRACE_SCOPE("FindPage partition");
+        const DocumentRange range{static_cast<int>(partition * partition_width),
+                                  static_cast<int>(std::min(id_count, (partition + 1) * partition_width) - 1)};
+        PartitionRelevance relevance;
+        ScoreDocuments<ScoringModel>(std::execution::seq, query, postings, document_filter, deadline_check, range,
+                                     relevance);
+        std::vector<Document> &documents = partition_documents[partition];
+        documents.reserve(relevance.document_to_relevance.size());
+        for (const auto [document_id, document_relevance] : relevance.document_to_relevance) {
+          documents.push_back({document_id, document_relevance, documents_.at(document_id).rating});
+        }
+        SelectPage(std::execution::seq, documents, partition_page);
+      }
+  );
+
+  std::vector<Document> matched_documents;
+  for (const std::vector<Document> &documents : partition_documents) {
+    matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+  }
+  SelectPage(std::execution::seq, matched_documents, page);
+  return matched_documents;
+}
+
+template<typename ScoringModel, typename DocumentFilter>
+std::vector<Document> SearchServer::FindAllDocuments(AutoExecutionPolicy,
+                                                     const Query &query,
+                                                     const QueryPostings &postings,
+                                                     DocumentFilter document_filter,
+                                                     DeadlineCheck &deadline_check) const {
+  const size_t thread_count = ChooseThreadCount(query, postings);
+  if (thread_count <= 1) {
+    return FindAllDocuments<ScoringModel>(std::execution::seq, query, postings, document_filter, deadline_check);
+  }
+  // Parallel algorithms run on the arena of the calling thread, it caps their threads
+  std::vector<Document> matched_documents;
+  tbb::task_arena(static_cast<int>(thread_count)).execute([&] {
+    matched_documents = FindAllDocuments<ScoringModel>(
+        std::execution::par, query, postings, document_filter, deadline_check);
+  });
+  return matched_documents;
+}
+
+template<typename ScoringModel, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
                                                      std::string_view raw_query,
-                                                     DocumentStatus status) const {
-  return FindTopDocuments(policy,
-                          raw_query,
-                          [status](int document_id, DocumentStatus document_status, int rating) {
-                            return document_status == status;
-                          });
+                                                     DocumentStatus status,
+                                                     const PageRequest &page) const {
+  return FindTopDocuments<ScoringModel>(policy, raw_query, status, page, QueryDeadline()).documents;
 }
 
-template<typename ExecutionPolicy>
+template<typename ScoringModel, typename ExecutionPolicy>
+TopDocuments SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                            std::string_view raw_query,
+                                            DocumentStatus status,
+                                            const PageRequest &page,
+                                            const QueryDeadline &deadline) const {
+  const Query query = GetValidParsedQuery(raw_query);
+  const Bitmap &status_documents = GetStatusDocuments(status);
+  if (status_documents.None()) {
+    return {};
+  }
+
+  DeadlineCheck deadline_check(deadline);
+  TopDocuments top_documents;
+  top_documents.documents = FindPage<ScoringModel>(
+      policy,
+      query,
+      ResolvePostings(query),
+      [&status_documents](int document_id) {
+        return status_documents.Test(document_id);
+      },
+      page,
+      deadline_check);
+  top_documents.is_truncated = deadline_check.HasExpired();
+  return top_documents;
+}
+
+template<typename ScoringModel, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                                     std::string_view raw_query,
+                                                     const FilterExpression &filter,
+                                                     const PageRequest &page) const {
+  const Query query = GetValidParsedQuery(raw_query);
+  const Bitmap candidates = filter.Evaluate({status_to_documents_, document_ratings_});
+  if (candidates.None()) {
+    return {};
+  }
+
+  DeadlineCheck deadline_check{QueryDeadline()};
+  return FindPage<ScoringModel>(
+      policy,
+      query,
+      ResolvePostings(query),
+      [&candidates](int document_id) {
+        return candidates.Test(document_id);
+      },
+      page,
+      deadline_check);
+}
+
+template<typename ScoringModel, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
                                                      std::string_view raw_query) const {
-  return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+  return FindTopDocuments<ScoringModel>(policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template<typename Callback>
+void SearchServer::ForEachWordWithPrefix(std::string_view prefix,
+                                         size_t max_word_count,
+                                         Callback callback) const {
+  size_t word_count = 0;
+  for (auto it = word_to_document_freqs_.lower_bound(prefix);
+       it != word_to_document_freqs_.end() && word_count < max_word_count
+           && std::string_view(it->first).substr(0, prefix.size()) == prefix;
+       ++it) {
+    if (!it->second.document_freqs.empty()) {
+      callback(std::string_view(it->first), it->second);
+      ++word_count;
+    }
+  }
+}
+
+template<typename ScoringModel, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy &&policy,
+                                                     const PreparedQuery &query,
+                                                     DocumentStatus status,
+                                                     const PageRequest &page) const {
+  const Bitmap &status_documents = GetStatusDocuments(status);
+  if (status_documents.None()) {
+    return {};
+  }
+
+  DeadlineCheck deadline_check{QueryDeadline()};
+  return FindPage<ScoringModel>(
+      policy,
+      query.query_,
+      GetPostings(query),
+      [&status_documents](int document_id) {
+        return status_documents.Test(document_id);
+      },
+      page,
+      deadline_check);
 }
 
 template<typename ExecutionPolicy>
-void SearchServer::RemoveDocument(ExecutionPolicy &&policy, int document_id) {
-  const auto document_to_word_freqs_it = document_to_word_freqs_.find(document_id);
-  if (document_to_word_freqs_it == document_to_word_freqs_.end()) {
-    return;
+DocumentMatches SearchServer::MatchDocuments(ExecutionPolicy &&policy,
+                                             std::string_view raw_query,
+                                             const std::vector<int> &document_ids) const {
+  const size_t document_count = document_ids.size();
+  std::vector<std::pair<int, size_t>> sorted_documents;
+  sorted_documents.reserve(document_count);
+  for (size_t i = 0; i < document_count; ++i) {
+    if (document_ids[i] < 0 || !document_ids_.count(document_ids[i])) {
+      throw std::out_of_range("Document is invalid"s);
+    }
+    sorted_documents.emplace_back(document_ids[i], i);
   }
-  std::vector<std::string_view> words;
+  std::sort(sorted_documents.begin(), sorted_documents.end());
+  const Query query = GetValidParsedQuery(raw_query);
+
+  std::vector<char> is_excluded(document_count);
+  for (std::string_view word : query.minus_words) {
+    const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
+    if (word_to_document_freqs_it != word_to_document_freqs_.end()) {
+      IntersectPostings(word_to_document_freqs_it->second.document_freqs, sorted_documents, [&is_excluded](size_t index) {
+        is_excluded[index] = true;
+      });
+    }
+  }
+  if (!query.minus_prefixes.empty()) {
+    std::for_each(policy, sorted_documents.begin(), sorted_documents.end(), [&](const auto &document) {
+      for (std::string_view prefix : query.minus_prefixes) {
+        if (!FindDocumentWordsWithPrefix(document.first, prefix).empty()) {
+          is_excluded[document.second] = true;
+          return;
+        }
+      }
+    });
+  }
+
+  // Indexes of the documents containing each plus word
+  std::vector<std::vector<size_t>> plus_word_documents(query.plus_words.size());
   std::transform(
-      document_to_word_freqs_it->second.begin(),
-      document_to_word_freqs_it->second.end(),
-      std::back_inserter(words),
-      [](const auto &word_freqs) { return word_freqs.first; });
-  document_ids_.erase(document_id);
-  documents_.erase(document_id);
-  document_to_word_freqs_.erase(document_id);
-  std::for_each(
       policy,
-      words.begin(),
-      words.end(),
-      [this, document_id](const auto &word) {
+      query.plus_words.begin(),
+      query.plus_words.end(),
+      plus_word_documents.begin(),
+      [this, &sorted_documents](std::string_view word) {
+        std::vector<size_t> indexes;
         const auto word_to_document_freqs_it = word_to_document_freqs_.find(word);
         if (word_to_document_freqs_it != word_to_document_freqs_.end()) {
-          word_to_document_freqs_it->second.erase(document_id);
+          IntersectPostings(word_to_document_freqs_it->second.document_freqs, sorted_documents, [&indexes](size_t index) {
+            indexes.push_back(index);
+          });
+        }
+        return indexes;
+      });
+  // Counting sort by document keeps the query word order within a document
+  std::vector<size_t> plus_offsets(document_count + 1);
+  for (const std::vector<size_t> &indexes : plus_word_documents) {
+    for (size_t index : indexes) {
+      ++plus_offsets[index + 1];
+    }
+  }
+  std::partial_sum(plus_offsets.begin(), plus_offsets.end(), plus_offsets.begin());
+  std::vector<std::string_view> plus_words(plus_offsets.back());
+  std::vector<size_t> next_plus_offsets(plus_offsets.begin(), plus_offsets.end() - 1);
+  for (size_t i = 0; i < query.plus_words.size(); ++i) {
+    for (size_t index : plus_word_documents[i]) {
+      plus_words[next_plus_offsets[index]++] = query.plus_words[i];
+    }
+  }
+  PointIntoIndex(query, plus_words);
+
+  // Phrases, prefixes and fuzzy words are matched against each document's own words
+  std::vector<std::vector<std::string_view>> extra_words(document_count);
+  if (!query.phrases.empty() || !query.plus_prefixes.empty() || !query.fuzzy_words.empty()) {
+    std::for_each(policy, sorted_documents.begin(), sorted_documents.end(), [&](const auto &document) {
+      const auto [document_id, index] = document;
+      if (is_excluded[index]) {
+        return;
+      }
+      std::vector<std::string_view> &words = extra_words[index];
+      for (const Phrase &phrase : query.phrases) {
+        if (DocumentContainsPhrase(phrase, document_id)) {
+          words.insert(words.end(), phrase.words.begin(), phrase.words.end());
         }
       }
-  );
+      PointIntoIndex(query, words);
+      for (std::string_view prefix : query.plus_prefixes) {
+        const std::vector<std::string_view> prefix_words = FindDocumentWordsWithPrefix(document_id, prefix);
+        words.insert(words.end(), prefix_words.begin(), prefix_words.end());
+      }
+      for (const FuzzyWord &fuzzy_word : query.fuzzy_words) {
+        const std::vector<std::string_view> fuzzy_words = FindDocumentWordsWithinDistance(document_id, fuzzy_word);
+        words.insert(words.end(), fuzzy_words.begin(), fuzzy_words.end());
+      }
+    });
+  }
+
+  DocumentMatches matches;
+  matches.words.reserve(plus_words.size());
+  matches.offsets.reserve(document_count + 1);
+  matches.offsets.push_back(0);
+  matches.statuses.reserve(document_count);
+  for (size_t i = 0; i < document_count; ++i) {
+    if (!is_excluded[i]) {
+      matches.words.insert(matches.words.end(),
+                           plus_words.begin() + plus_offsets[i],
+                           plus_words.begin() + plus_offsets[i + 1]);
+      for (std::string_view word : extra_words[i]) {
+        const auto document_words_begin = matches.words.begin() + matches.offsets.back();
+        if (std::find(document_words_begin, matches.words.end(), word) == matches.words.end()) {
+          matches.words.push_back(word);
+        }
+      }
+    }
+    matches.offsets.push_back(matches.words.size());
+    matches.statuses.push_back(documents_.at(document_ids[i]).status);
+  }
+  return matches;
+}
+
+template<typename Callback>
+void SearchServer::IntersectPostings(const std::map<int, TermFreq> &document_freqs,
+                                     const std::vector<std::pair<int, size_t>> &sorted_documents,
+                                     Callback callback) {
+  auto document_it = sorted_documents.begin();
+  const auto documents_end = sorted_documents.end();
+  while (document_it != documents_end) {
+    const auto posting_it = document_freqs.lower_bound(document_it->first);
+    if (posting_it == document_freqs.end()) {
+      return;
+    }
+    const int posting_id = posting_it->first;
+    // Documents before low are known to precede the posting, high does not or is the end
+    auto low = document_it;
+    auto high = document_it;
+    for (ptrdiff_t step = 1; high != documents_end && high->first < posting_id; step *= 2) {
+      low = high + 1;
+      high += std::min(step, documents_end - high);
+    }
+    document_it = std::lower_bound(low, high, posting_id, [](const auto &document, int id) {
+      return document.first < id;
+    });
+    if (document_it != documents_end && document_it->first == posting_id) {
+      callback(document_it->second);
+      ++document_it;
+    }
+  }
+}
+
+template<typename ExecutionPolicy>
+void SearchServer::RemoveDocument(ExecutionPolicy &&policy, int document_id) {
+  TRACE_SCOPE("RemoveDocument");
+  const auto documents_it = documents_.find(document_id);
+  if (documents_it == documents_.end()) {
+    return;
+  }
+  status_to_documents_[static_cast<int>(documents_it->second.status)].Reset(document_id);
+  document_ratings_.Erase(document_id);
+  total_document_length_ -= document_lengths_.Get(document_id);
+  document_lengths_.Erase(document_id);
+  document_ids_.erase(document_id);
+  documents_.erase(documents_it);
+  for (PostingList *posting_list : GetDocumentPostings(document_to_word_freqs_.at(document_id))) {
+    ++posting_list->removed_document_count;
+  }
+  removed_documents_.Set(document_id);
+  ++removed_document_count_;
+  if (removed_document_count_ >= compaction_garbage_ratio_ * (document_ids_.size() + removed_document_count_)) {
+    CompactPostings(policy);
+  }
+}
+
+template<typename ExecutionPolicy>
+void SearchServer::CompactPostings(ExecutionPolicy &&policy) {
+  if (removed_document_count_ == 0) {
+    return;
+  }
+  // Every posting list is swept once instead of looking up each word of each removed document
+  const auto erase_removed_documents = [this](auto *document_values) {
+    TRACE_SCOPE("CompactPostings word");
+    for (auto it = document_values->begin(); it != document_values->end();) {
+      it = removed_documents_.Test(it->first) ? document_values->erase(it) : std::next(it);
+    }
+  };
+  std::vector<std::map<int, TermFreq> *> word_document_freqs;
+  word_document_freqs.reserve(word_to_document_freqs_.size());
+  for (auto &[_, posting_list] : word_to_document_freqs_) {
+    word_document_freqs.push_back(&posting_list.document_freqs);
+    posting_list.removed_document_count = 0;
+  }
+  std::for_each(policy, word_document_freqs.begin(), word_document_freqs.end(), erase_removed_documents);
+  std::vector<std::map<int, PositionList> *> word_document_positions;
+  word_document_positions.reserve(word_to_document_positions_.size());
+  for (auto &[_, document_positions] : word_to_document_positions_) {
+    word_document_positions.push_back(&document_positions);
+  }
+  std::for_each(policy, word_document_positions.begin(), word_document_positions.end(), erase_removed_documents);
+  erase_removed_documents(&document_to_word_freqs_);
+  removed_documents_ = Bitmap();
+  removed_document_count_ = 0;
 }
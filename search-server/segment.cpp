@@ -0,0 +1,97 @@
+#include "segment.h"
+
+#include <algorithm>
+
+using namespace std;
+
+Segment::Segment(const map<string, map<int, TermFreq>, less<>> &word_to_document_freqs,
+                 vector<DocumentData> documents)
+    : documents_(move(documents)) {
+  words_.reserve(word_to_document_freqs.size());
+  posting_offsets_.reserve(word_to_document_freqs.size() + 1);
+  posting_offsets_.push_back(0);
+  for (const auto &[word, document_freqs] : word_to_document_freqs) {
+    if (document_freqs.empty()) {
+      continue;
+    }
+    words_.push_back(word);
+    for (const auto [document_id, term_freq] : document_freqs) {
+      postings_.push_back({document_id, term_freq});
+    }
+    posting_offsets_.push_back(postings_.size());
+  }
+}
+
+Segment Segment::Merge(const vector<const Segment *> &segments, const vector<const Bitmap *> &tombstones) {
+  // Words are views into the merged segments, they outlive the merge
+  map<string_view, vector<Posting>> word_to_postings;
+  Segment merged;
+  for (size_t i = 0; i < segments.size(); ++i) {
+    const Segment &segment = *segments[i];
+    const Bitmap &deleted_documents = *tombstones[i];
+    for (size_t word_index = 0; word_index < segment.words_.size(); ++word_index) {
+      vector<Posting> *postings = nullptr;
+      for (size_t j = segment.posting_offsets_[word_index]; j < segment.posting_offsets_[word_index + 1]; ++j) {
+        const Posting &posting = segment.postings_[j];
+        if (deleted_documents.Test(posting.document_id)) {
+          continue;
+        }
+        if (!postings) {
+          postings = &word_to_postings[segment.words_[word_index]];
+        }
+        postings->push_back(posting);
+      }
+    }
+    for (const DocumentData &document : segment.documents_) {
+      if (!deleted_documents.Test(document.id)) {
+        merged.documents_.push_back(document);
+      }
+    }
+  }
+  const auto by_id = [](const auto &lhs, const auto &rhs) {
+    return lhs.id < rhs.id;
+  };
+  sort(merged.documents_.begin(), merged.documents_.end(), by_id);
+
+  merged.words_.reserve(word_to_postings.size());
+  merged.posting_offsets_.reserve(word_to_postings.size() + 1);
+  merged.posting_offsets_.push_back(0);
+  for (auto &[word, postings] : word_to_postings) {
+    // Live document ids are unique across segments, postings only need interleaving
+    sort(postings.begin(), postings.end(), [](const Posting &lhs, const Posting &rhs) {
+      return lhs.document_id < rhs.document_id;
+    });
+    merged.words_.emplace_back(word);
+    merged.postings_.insert(merged.postings_.end(), postings.begin(), postings.end());
+    merged.posting_offsets_.push_back(merged.postings_.size());
+  }
+  return merged;
+}
+
+Segment::PostingRange Segment::FindPostings(string_view word) const {
+  const auto words_it = lower_bound(words_.begin(), words_.end(), word);
+  if (words_it == words_.end() || *words_it != word) {
+    return PostingRange(postings_.end(), postings_.end());
+  }
+  const size_t word_index = words_it - words_.begin();
+  return PostingRange(postings_.begin() + posting_offsets_[word_index],
+                      postings_.begin() + posting_offsets_[word_index + 1]);
+}
+
+const Segment::DocumentData *Segment::FindDocument(int document_id) const {
+  const auto documents_it = lower_bound(
+      documents_.begin(),
+      documents_.end(),
+      document_id,
+      [](const DocumentData &document, int id) {
+        return document.id < id;
+      });
+  if (documents_it == documents_.end() || documents_it->id != document_id) {
+    return nullptr;
+  }
+  return &*documents_it;
+}
+
+const vector<Segment::DocumentData> &Segment::GetDocuments() const {
+  return documents_;
+}
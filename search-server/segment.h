@@ -0,0 +1,54 @@
+#pragma once
+
+#include "bitmap.h"
+#include "document.h"
+#include "paginator.h"
+#include "term_freq.h"
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable part of a SegmentedIndex: a sorted word dictionary over one flat postings array,
+// postings of a word are sorted by document id
+class Segment {
+ public:
+  struct Posting {
+    int document_id;
+    TermFreq term_freq;
+  };
+
+  struct DocumentData {
+    int id;
+    int rating;
+    DocumentStatus status;
+  };
+
+  using PostingRange = IteratorRange<std::vector<Posting>::const_iterator>;
+
+  // Documents must be sorted by id
+  Segment(const std::map<std::string, std::map<int, TermFreq>, std::less<>> &word_to_document_freqs,
+          std::vector<DocumentData> documents);
+
+  // Merged segment holds the documents of all segments except those in their tombstones
+  static Segment Merge(const std::vector<const Segment *> &segments,
+                       const std::vector<const Bitmap *> &tombstones);
+
+  // Empty range if no document of the segment contains the word
+  PostingRange FindPostings(std::string_view word) const;
+
+  // nullptr if the document is not in the segment
+  const DocumentData *FindDocument(int document_id) const;
+
+  const std::vector<DocumentData> &GetDocuments() const;
+
+ private:
+  std::vector<std::string> words_;
+  // Postings of words_[i] are postings_[posting_offsets_[i]] .. postings_[posting_offsets_[i + 1] - 1]
+  std::vector<size_t> posting_offsets_;
+  std::vector<Posting> postings_;
+  std::vector<DocumentData> documents_;
+
+  Segment() = default;
+};
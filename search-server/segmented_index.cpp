@@ -0,0 +1,328 @@
+#include "segmented_index.h"
+#include "scoring_model.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+SegmentedIndex::SegmentedIndex(string_view stop_words_text, size_t write_buffer_document_count)
+    : stop_words_(MakeUniqueNonEmptyStrings(SplitIntoWords(stop_words_text))),
+      write_buffer_document_count_(max<size_t>(write_buffer_document_count, 1)),
+      merge_thread_([this] { RunMerges(); }) {
+  if (!SearchServer::IsValidWord(stop_words_text)) {
+    {
+      lock_guard guard(mutex_);
+      is_stopping_ = true;
+    }
+    merge_state_changed_.notify_all();
+    merge_thread_.join();
+    throw invalid_argument("Stop words contain forbidden symbols"s);
+  }
+}
+
+SegmentedIndex::~SegmentedIndex() {
+  {
+    lock_guard guard(mutex_);
+    is_stopping_ = true;
+  }
+  merge_state_changed_.notify_all();
+  merge_thread_.join();
+}
+
+void SegmentedIndex::AddDocument(int document_id, string_view document, DocumentStatus status,
+                                 const vector<int> &ratings) {
+  if (document_id < 0) {
+    throw invalid_argument("Document id must not be negative"s);
+  }
+  if (!SearchServer::IsValidWord(document)) {
+    throw invalid_argument("Document contains forbidden symbols"s);
+  }
+  vector<string_view> words = SplitIntoWords(document);
+  words.erase(remove_if(words.begin(), words.end(), [this](string_view word) {
+    return stop_words_.Contains(word);
+  }), words.end());
+  const int rating = ratings.empty()
+      ? 0
+      : accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
+
+  unique_lock lock(mutex_);
+  if (ContainsDocument(document_id)) {
+    throw invalid_argument("Document with id "s + to_string(document_id) + " already exists"s);
+  }
+  // Counted up front like in SearchServer, a quantized TermFreq cannot be accumulated
+  map<string_view, int> word_counts;
+  for (const string_view word : words) {
+    ++word_counts[word];
+  }
+  const double inv_word_count = 1.0 / words.size();
+  vector<string_view> &document_words = buffer_document_words_[document_id];
+  for (const auto [word, count] : word_counts) {
+    auto word_to_document_freqs_it = buffer_word_to_document_freqs_.find(word);
+    if (word_to_document_freqs_it == buffer_word_to_document_freqs_.end()) {
+      word_to_document_freqs_it = buffer_word_to_document_freqs_.emplace(string(word), map<int, TermFreq>{}).first;
+    }
+    word_to_document_freqs_it->second.emplace(document_id, count * inv_word_count);
+    document_words.push_back(word_to_document_freqs_it->first);
+  }
+  buffer_documents_.emplace(document_id, Segment::DocumentData{document_id, rating, status});
+  ++document_count_;
+  if (buffer_documents_.size() >= write_buffer_document_count_) {
+    FlushLocked();
+  }
+}
+
+void SegmentedIndex::RemoveDocument(int document_id) {
+  unique_lock lock(mutex_);
+  const auto buffer_document_words_it = buffer_document_words_.find(document_id);
+  if (buffer_document_words_it != buffer_document_words_.end()) {
+    for (const string_view word : buffer_document_words_it->second) {
+      const auto word_to_document_freqs_it = buffer_word_to_document_freqs_.find(word);
+      if (word_to_document_freqs_it == buffer_word_to_document_freqs_.end()) {
+        continue;
+      }
+      word_to_document_freqs_it->second.erase(document_id);
+      // No other buffered document holds a view of the word
+      if (word_to_document_freqs_it->second.empty()) {
+        buffer_word_to_document_freqs_.erase(word_to_document_freqs_it);
+      }
+    }
+    buffer_document_words_.erase(buffer_document_words_it);
+    buffer_documents_.erase(document_id);
+    --document_count_;
+    return;
+  }
+  for (SegmentEntry &entry : segments_) {
+    if (entry.segment->FindDocument(document_id) && !entry.tombstones.Test(document_id)) {
+      entry.tombstones.Set(document_id);
+      entry.deleted_ids.push_back(document_id);
+      --document_count_;
+      merge_state_changed_.notify_all();
+      return;
+    }
+  }
+}
+
+vector<Document> SegmentedIndex::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+  const Query query = ParseQuery(raw_query);
+  shared_lock lock(mutex_);
+
+  // Calls callback(document, term_freq) for the live postings of the word in every segment
+  const auto for_each_posting = [this](string_view word, auto callback) {
+    for (const SegmentEntry &entry : segments_) {
+      for (const Segment::Posting &posting : entry.segment->FindPostings(word)) {
+        if (!entry.tombstones.Test(posting.document_id)) {
+          callback(*entry.segment->FindDocument(posting.document_id), posting.term_freq);
+        }
+      }
+    }
+    const auto word_to_document_freqs_it = buffer_word_to_document_freqs_.find(word);
+    if (word_to_document_freqs_it != buffer_word_to_document_freqs_.end()) {
+      for (const auto [document_id, term_freq] : word_to_document_freqs_it->second) {
+        callback(buffer_documents_.at(document_id), term_freq);
+      }
+    }
+  };
+
+  // Tf-idf reads no document lengths
+  const DocumentColumn document_lengths;
+  const TfIdf scoring_model({document_count_, document_lengths, 0});
+  map<int, Document> document_to_match;
+  for (const string_view word : query.plus_words) {
+    size_t document_freq = 0;
+    for_each_posting(word, [&document_freq](const Segment::DocumentData &, double) {
+      ++document_freq;
+    });
+    if (document_freq == 0) {
+      continue;
+    }
+    const double word_weight = scoring_model.ComputeWordWeight(document_freq);
+    for_each_posting(word, [&](const Segment::DocumentData &document, double term_freq) {
+      if (document.status == status) {
+        Document &match = document_to_match[document.id];
+        match.id = document.id;
+        match.rating = document.rating;
+        match.relevance += scoring_model.Score(word_weight, term_freq, document.id);
+      }
+    });
+  }
+  for (const string_view word : query.minus_words) {
+    for_each_posting(word, [&document_to_match](const Segment::DocumentData &document, double) {
+      document_to_match.erase(document.id);
+    });
+  }
+  lock.unlock();
+
+  vector<Document> matched_documents;
+  matched_documents.reserve(document_to_match.size());
+  for (const auto &[_, document] : document_to_match) {
+    matched_documents.push_back(document);
+  }
+  const size_t result_count = min<size_t>(matched_documents.size(), MAX_RESULT_DOCUMENT_COUNT);
+  partial_sort(matched_documents.begin(),
+               matched_documents.begin() + result_count,
+               matched_documents.end(),
+               SearchServer::IsRankedBefore);
+  matched_documents.resize(result_count);
+  return matched_documents;
+}
+
+int SegmentedIndex::GetDocumentCount() const {
+  shared_lock lock(mutex_);
+  return document_count_;
+}
+
+size_t SegmentedIndex::GetSegmentCount() const {
+  shared_lock lock(mutex_);
+  return segments_.size();
+}
+
+void SegmentedIndex::Flush() {
+  unique_lock lock(mutex_);
+  FlushLocked();
+}
+
+void SegmentedIndex::WaitForMerges() {
+  unique_lock lock(mutex_);
+  merge_state_changed_.wait(lock, [this] {
+    return !is_merging_ && FindMergeCandidates().empty();
+  });
+}
+
+bool SegmentedIndex::ContainsDocument(int document_id) const {
+  if (buffer_documents_.count(document_id)) {
+    return true;
+  }
+  return any_of(segments_.begin(), segments_.end(), [document_id](const SegmentEntry &entry) {
+    return entry.segment->FindDocument(document_id) && !entry.tombstones.Test(document_id);
+  });
+}
+
+void SegmentedIndex::FlushLocked() {
+  if (buffer_documents_.empty()) {
+    return;
+  }
+  vector<Segment::DocumentData> documents;
+  documents.reserve(buffer_documents_.size());
+  for (const auto &[_, document] : buffer_documents_) {
+    documents.push_back(document);
+  }
+  segments_.push_back({make_shared<const Segment>(buffer_word_to_document_freqs_, move(documents)), {}, {}});
+  buffer_document_words_.clear();
+  buffer_word_to_document_freqs_.clear();
+  buffer_documents_.clear();
+  merge_state_changed_.notify_all();
+}
+
+vector<size_t> SegmentedIndex::FindMergeCandidates() const {
+  // Tier k holds segments of write_buffer * MERGE_FACTOR^k live documents or more
+  map<int, vector<size_t>> tier_to_segments;
+  for (size_t i = 0; i < segments_.size(); ++i) {
+    const size_t document_count = segments_[i].segment->GetDocuments().size();
+    const size_t deleted_count = segments_[i].deleted_ids.size();
+    // Mostly deleted segment is rewritten alone to reclaim its postings
+    if (deleted_count * 2 >= document_count) {
+      return {i};
+    }
+    int tier = 0;
+    for (size_t tier_size = write_buffer_document_count_ * SEGMENT_MERGE_FACTOR;
+         document_count - deleted_count >= tier_size;
+         tier_size *= SEGMENT_MERGE_FACTOR) {
+      ++tier;
+    }
+    vector<size_t> &tier_segments = tier_to_segments[tier];
+    tier_segments.push_back(i);
+    if (tier_segments.size() == SEGMENT_MERGE_FACTOR) {
+      return tier_segments;
+    }
+  }
+  return {};
+}
+
+void SegmentedIndex::RunMerges() {
+  unique_lock lock(mutex_);
+  while (true) {
+    vector<size_t> candidates;
+    merge_state_changed_.wait(lock, [this, &candidates] {
+      if (is_stopping_) {
+        return true;
+      }
+      candidates = FindMergeCandidates();
+      return !candidates.empty();
+    });
+    if (is_stopping_) {
+      return;
+    }
+    is_merging_ = true;
+    vector<shared_ptr<const Segment>> segments;
+    vector<Bitmap> tombstones;
+    vector<size_t> deleted_counts;
+    for (const size_t i : candidates) {
+      segments.push_back(segments_[i].segment);
+      tombstones.push_back(segments_[i].tombstones);
+      deleted_counts.push_back(segments_[i].deleted_ids.size());
+    }
+
+    // Segments are immutable, queries and mutations go on while they are merged
+    lock.unlock();
+    vector<const Segment *> segment_ptrs;
+    vector<const Bitmap *> tombstone_ptrs;
+    for (size_t i = 0; i < segments.size(); ++i) {
+      segment_ptrs.push_back(segments[i].get());
+      tombstone_ptrs.push_back(&tombstones[i]);
+    }
+    SegmentEntry merged_entry{make_shared<const Segment>(Segment::Merge(segment_ptrs, tombstone_ptrs)), {}, {}};
+    lock.lock();
+
+    // Only this thread erases segments, the candidates are still at their indexes
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      const vector<int> &deleted_ids = segments_[candidates[i]].deleted_ids;
+      for (size_t j = deleted_counts[i]; j < deleted_ids.size(); ++j) {
+        merged_entry.tombstones.Set(deleted_ids[j]);
+        merged_entry.deleted_ids.push_back(deleted_ids[j]);
+      }
+    }
+    for (auto it = candidates.rbegin(); it != candidates.rend(); ++it) {
+      segments_.erase(segments_.begin() + *it);
+    }
+    if (!merged_entry.segment->GetDocuments().empty()) {
+      segments_.push_back(move(merged_entry));
+    }
+    is_merging_ = false;
+    merge_state_changed_.notify_all();
+  }
+}
+
+SegmentedIndex::Query SegmentedIndex::ParseQuery(string_view raw_query) const {
+  if (!SearchServer::IsValidWord(raw_query)) {
+    throw invalid_argument("Query contains forbidden symbols"s);
+  }
+  if (raw_query.find('"') != string_view::npos) {
+    throw invalid_argument("Segmented index does not support phrases"s);
+  }
+  Query query;
+  for (string_view word : SplitIntoWords(raw_query)) {
+    const bool is_minus = word[0] == '-';
+    if (is_minus) {
+      word.remove_prefix(1);
+      if (word.empty() || word[0] == '-') {
+        throw invalid_argument("Invalid query"s);
+      }
+    }
+    // Same forms SearchServer takes for prefixes and fuzzy words, they must not match literally
+    const size_t tilde_pos = word.rfind('~');
+    if (word.back() == '*'
+        || (tilde_pos != string_view::npos
+            && (tilde_pos + 1 == word.size()
+                || (tilde_pos + 2 == word.size() && word.back() >= '1' && word.back() <= '0' + MAX_FUZZY_DISTANCE)))) {
+      throw invalid_argument("Segmented index does not support prefixes and fuzzy words"s);
+    }
+    if (!stop_words_.Contains(word)) {
+      (is_minus ? query.minus_words : query.plus_words).insert(word);
+    }
+  }
+  return query;
+}
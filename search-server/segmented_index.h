@@ -0,0 +1,94 @@
+#pragma once
+
+#include "segment.h"
+#include "stop_word_set.h"
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Documents buffered in memory before they are written out as a segment
+const size_t DEFAULT_WRITE_BUFFER_DOCUMENT_COUNT = 1000;
+
+// Segments of one tier are merged into the next tier once there are this many of them
+const size_t SEGMENT_MERGE_FACTOR = 4;
+
+// Index of immutable segments plus a mutable write buffer. Removing a document only marks it
+// in its segment's tombstones, a background thread merges segments under a tiered policy and
+// drops tombstoned postings on the way. Queries support plus and minus words and are safe to
+// run concurrently with mutations
+class SegmentedIndex {
+ public:
+  explicit SegmentedIndex(std::string_view stop_words_text,
+                          size_t write_buffer_document_count = DEFAULT_WRITE_BUFFER_DOCUMENT_COUNT);
+
+  SegmentedIndex(const SegmentedIndex &) = delete;
+
+  SegmentedIndex &operator=(const SegmentedIndex &) = delete;
+
+  ~SegmentedIndex();
+
+  void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                   const std::vector<int> &ratings);
+
+  void RemoveDocument(int document_id);
+
+  // Plus and minus words only, phrases, prefixes and fuzzy words throw invalid_argument
+  std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                         DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+  int GetDocumentCount() const;
+
+  size_t GetSegmentCount() const;
+
+  // Writes the buffered documents out as a segment
+  void Flush();
+
+  // Blocks until no merge is running or due
+  void WaitForMerges();
+
+ private:
+  struct SegmentEntry {
+    std::shared_ptr<const Segment> segment;
+    Bitmap tombstones;
+    // Tombstoned ids in order, lets a merge catch up with removals made while it ran
+    std::vector<int> deleted_ids;
+  };
+
+  struct Query {
+    std::set<std::string_view> plus_words;
+    std::set<std::string_view> minus_words;
+  };
+
+  const StopWordSet stop_words_;
+  const size_t write_buffer_document_count_;
+
+  std::map<std::string, std::map<int, TermFreq>, std::less<>> buffer_word_to_document_freqs_;
+  std::map<int, std::vector<std::string_view>> buffer_document_words_;
+  std::map<int, Segment::DocumentData> buffer_documents_;
+  std::vector<SegmentEntry> segments_;
+  int document_count_ = 0;
+
+  mutable std::shared_mutex mutex_;
+  std::condition_variable_any merge_state_changed_;
+  bool is_merging_ = false;
+  bool is_stopping_ = false;
+  std::thread merge_thread_;
+
+  bool ContainsDocument(int document_id) const;
+
+  void FlushLocked();
+
+  // Indexes into segments_ of the next segments to merge, empty if no merge is due
+  std::vector<size_t> FindMergeCandidates() const;
+
+  void RunMerges();
+
+  Query ParseQuery(std::string_view raw_query) const;
+};
@@ -0,0 +1,129 @@
+#include "serving_index.h"
+#include "corpus_loader.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+struct ServingIndex::Reclaimer {
+  mutex mutex_;
+  condition_variable state_changed_;
+  vector<const SearchServer *> retired_;
+  uint64_t retired_count_ = 0;
+  uint64_t reclaimed_count_ = 0;
+  bool is_stopping_ = false;
+
+  // Called by whoever drops the last handle of a version
+  void Retire(const SearchServer *search_server) {
+    {
+      lock_guard guard(mutex_);
+      if (!is_stopping_) {
+        retired_.push_back(search_server);
+        ++retired_count_;
+        state_changed_.notify_all();
+        return;
+      }
+    }
+    delete search_server;
+  }
+
+  void Run() {
+    unique_lock lock(mutex_);
+    while (true) {
+      state_changed_.wait(lock, [this] {
+        return is_stopping_ || !retired_.empty();
+      });
+      if (retired_.empty()) {
+        return;
+      }
+      vector<const SearchServer *> retired;
+      retired.swap(retired_);
+      lock.unlock();
+      for (const SearchServer *search_server : retired) {
+        delete search_server;
+      }
+      lock.lock();
+      reclaimed_count_ += retired.size();
+      state_changed_.notify_all();
+    }
+  }
+};
+
+ServingIndex::ServingIndex(unique_ptr<SearchServer> search_server)
+    : reclaimer_(make_shared<Reclaimer>()),
+      reclaim_thread_([reclaimer = reclaimer_] { reclaimer->Run(); }) {
+  try {
+    Publish(move(search_server));
+  } catch (...) {
+    // The destructor does not run for a failed construction, the thread must not outlive it
+    StopReclaimer();
+    throw;
+  }
+}
+
+ServingIndex::~ServingIndex() {
+  atomic_store(&current_, Handle());
+  StopReclaimer();
+}
+
+void ServingIndex::StopReclaimer() {
+  {
+    lock_guard guard(reclaimer_->mutex_);
+    reclaimer_->is_stopping_ = true;
+  }
+  reclaimer_->state_changed_.notify_all();
+  reclaim_thread_.join();
+}
+
+ServingIndex::Handle ServingIndex::Acquire() const {
+  return atomic_load(&current_);
+}
+
+uint64_t ServingIndex::Publish(unique_ptr<SearchServer> search_server) {
+  if (!search_server) {
+    throw invalid_argument("Published search server must not be null"s);
+  }
+  Handle handle = MakeHandle(move(search_server));
+  // Version numbers follow the order of the swaps
+  lock_guard guard(publish_mutex_);
+  handle = atomic_exchange(&current_, move(handle));
+  // The previous version is released here, or by its last reader through the reclaimer
+  return ++version_;
+}
+
+future<uint64_t> ServingIndex::RebuildAsync(function<unique_ptr<SearchServer>()> build) {
+  return async(launch::async, [this, build = move(build)] {
+    return Publish(build());
+  });
+}
+
+future<uint64_t> ServingIndex::LoadCorpusAsync(const string &stop_words_text,
+                                               const string &path,
+                                               size_t tokenizer_count) {
+  return RebuildAsync([stop_words_text, path, tokenizer_count] {
+    auto search_server = make_unique<SearchServer>(stop_words_text);
+    LoadCorpus(*search_server, path, tokenizer_count);
+    return search_server;
+  });
+}
+
+uint64_t ServingIndex::GetVersion() const {
+  return version_;
+}
+
+void ServingIndex::WaitForReclamation() const {
+  unique_lock lock(reclaimer_->mutex_);
+  reclaimer_->state_changed_.wait(lock, [this] {
+    return reclaimer_->reclaimed_count_ == reclaimer_->retired_count_;
+  });
+}
+
+ServingIndex::Handle ServingIndex::MakeHandle(unique_ptr<SearchServer> search_server) const {
+  // Deleter keeps the reclaimer alive, a handle dropped after shutdown frees inline
+  return Handle(search_server.release(), [reclaimer = reclaimer_](const SearchServer *retired) {
+    reclaimer->Retire(retired);
+  });
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Serves queries from the current SearchServer and swaps in a rebuilt one in a single atomic
+// step. Readers pin a version through a reference-counted handle, so in-flight queries finish
+// on the version they started on. A retired version is destroyed on a background thread once
+// its last handle is dropped, so no query pays for tearing down an index
+class ServingIndex {
+ public:
+  using Handle = std::shared_ptr<const SearchServer>;
+
+  explicit ServingIndex(std::unique_ptr<SearchServer> search_server);
+
+  ServingIndex(const ServingIndex &) = delete;
+
+  ServingIndex &operator=(const ServingIndex &) = delete;
+
+  // Versions whose handles outlive the ServingIndex are freed by their last reader
+  ~ServingIndex();
+
+  // Current version, it stays alive while the handle is held
+  Handle Acquire() const;
+
+  // Queries after it see the new version, returns its version number
+  uint64_t Publish(std::unique_ptr<SearchServer> search_server);
+
+  // Builds a new version on a background thread and publishes it, the future holds its
+  // version number or the exception the build threw
+  std::future<uint64_t> RebuildAsync(std::function<std::unique_ptr<SearchServer>()> build);
+
+  // Rebuilds from a corpus file in LoadCorpus format. Tokenizes on one thread by default to
+  // leave the cores to queries
+  std::future<uint64_t> LoadCorpusAsync(const std::string &stop_words_text,
+                                        const std::string &path,
+                                        size_t tokenizer_count = 1);
+
+  uint64_t GetVersion() const;
+
+  // Blocks until every version retired so far with no handles left is destroyed
+  void WaitForReclamation() const;
+
+  template<typename... Args>
+  auto FindTopDocuments(Args &&... args) const {
+    return Acquire()->FindTopDocuments(std::forward<Args>(args)...);
+  }
+
+ private:
+  struct Reclaimer;
+
+  std::shared_ptr<Reclaimer> reclaimer_;
+  std::thread reclaim_thread_;
+  // Accessed with std::atomic_load and std::atomic_store only
+  Handle current_;
+  std::atomic<uint64_t> version_ = 0;
+  std::mutex publish_mutex_;
+
+  Handle MakeHandle(std::unique_ptr<SearchServer> search_server) const;
+
+  // Lets the reclaimer free what is retired so far and joins its thread
+  void StopReclaimer();
+};
@@ -0,0 +1,86 @@
+#include "stop_word_set.h"
+
+#include <numeric>
+
+using namespace std;
+
+// Buckets hold this many words on average, bigger buckets are slower to place
+const size_t WORDS_PER_BUCKET = 4;
+
+// Displacements tried for one bucket before the whole table is hashed with a new seed
+const uint64_t MAX_DISPLACEMENT_ATTEMPTS = 1 << 16;
+
+StopWordSet::StopWordSet(const set<string, less<>> &words) {
+  if (words.empty()) {
+    return;
+  }
+  const vector<string_view> word_views(words.begin(), words.end());
+  for (const string_view word : word_views) {
+    length_mask_ |= uint64_t{1} << min<size_t>(word.size(), 63);
+    const auto first_byte = static_cast<uint8_t>(word[0]);
+    first_byte_masks_[first_byte / 64] |= uint64_t{1} << (first_byte % 64);
+  }
+  while (!TryPlace(word_views)) {
+    ++hash_seed_;
+  }
+}
+
+size_t StopWordSet::size() const {
+  return words_.size();
+}
+
+vector<string>::const_iterator StopWordSet::begin() const {
+  return words_.begin();
+}
+
+vector<string>::const_iterator StopWordSet::end() const {
+  return words_.end();
+}
+
+bool StopWordSet::TryPlace(const vector<string_view> &words) {
+  // Hash and displace: the biggest buckets are placed first while most slots are free
+  words_.assign(words.size(), string());
+  displacements_.assign((words.size() + WORDS_PER_BUCKET - 1) / WORDS_PER_BUCKET, 0);
+  vector<vector<uint64_t>> bucket_hashes(displacements_.size());
+  vector<vector<string_view>> bucket_words(displacements_.size());
+  for (const string_view word : words) {
+    const uint64_t hash = Hash(word, hash_seed_);
+    bucket_hashes[hash % displacements_.size()].push_back(hash);
+    bucket_words[hash % displacements_.size()].push_back(word);
+  }
+  vector<size_t> bucket_order(displacements_.size());
+  iota(bucket_order.begin(), bucket_order.end(), 0);
+  sort(bucket_order.begin(), bucket_order.end(), [&bucket_hashes](size_t lhs, size_t rhs) {
+    return bucket_hashes[lhs].size() > bucket_hashes[rhs].size();
+  });
+
+  vector<char> is_taken(words.size());
+  vector<size_t> slots;
+  for (const size_t bucket : bucket_order) {
+    const vector<uint64_t> &hashes = bucket_hashes[bucket];
+    slots.clear();
+    bool is_placed = hashes.empty();
+    for (uint64_t displacement = 0; !is_placed && displacement < MAX_DISPLACEMENT_ATTEMPTS; ++displacement) {
+      slots.clear();
+      is_placed = all_of(hashes.begin(), hashes.end(), [&](uint64_t hash) {
+        const size_t slot = GetSlot(hash, displacement);
+        if (is_taken[slot] || find(slots.begin(), slots.end(), slot) != slots.end()) {
+          return false;
+        }
+        slots.push_back(slot);
+        return true;
+      });
+      if (is_placed) {
+        displacements_[bucket] = displacement;
+      }
+    }
+    if (!is_placed) {
+      return false;
+    }
+    for (size_t i = 0; i < slots.size(); ++i) {
+      is_taken[slots[i]] = true;
+      words_[slots[i]] = string(bucket_words[bucket][i]);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "hash.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable set of stop words behind a minimal perfect hash. A lookup checks the length and
+// the first byte against masks of the stop words, then compares with the one word whose slot
+// the query hashes to
+class StopWordSet {
+ public:
+  StopWordSet() = default;
+
+  explicit StopWordSet(const std::set<std::string, std::less<>> &words);
+
+  bool Contains(std::string_view word) const {
+    if (word.empty() || words_.empty()) {
+      return false;
+    }
+    const auto first_byte = static_cast<uint8_t>(word[0]);
+    if (!(length_mask_ >> std::min<size_t>(word.size(), 63) & 1u)
+        || !(first_byte_masks_[first_byte / 64] >> (first_byte % 64) & 1u)) {
+      return false;
+    }
+    const uint64_t hash = Hash(word, hash_seed_);
+    return words_[GetSlot(hash, displacements_[hash % displacements_.size()])] == word;
+  }
+
+  size_t size() const;
+
+  // Words in slot order
+  std::vector<std::string>::const_iterator begin() const;
+
+  std::vector<std::string>::const_iterator end() const;
+
+ private:
+  // Word of slot i, every slot is taken
+  std::vector<std::string> words_;
+  // Words are grouped into buckets by hash, a bucket is placed by its displacement
+  std::vector<uint64_t> displacements_;
+  uint64_t hash_seed_ = 0;
+  // Bit min(length, 63) is set for every stop word length
+  uint64_t length_mask_ = 0;
+  std::array<uint64_t, 4> first_byte_masks_{};
+
+  // FNV-1a
+  static uint64_t Hash(std::string_view word, uint64_t seed) {
+    uint64_t hash = 0xcbf29ce484222325u ^ seed;
+    for (const char c : word) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3u;
+    }
+    return hash;
+  }
+
+  size_t GetSlot(uint64_t hash, uint64_t displacement) const {
+    // The displaced hash is mixed again, a displacement must move the word to an unrelated slot
+    return MixHash(hash ^ displacement) % words_.size();
+  }
+
+  // False if some bucket found no free slots, then another seed is tried
+  bool TryPlace(const std::vector<std::string_view> &words);
+};
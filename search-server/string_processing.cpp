@@ -9,10 +9,20 @@ vector<string_view> SplitIntoWords(string_view text) {
   }
   for (size_t start = 0; start <= text.size();) {
     size_t end = text.find(' ', start);
-    if (start != end) {
+    if (start != end && start != text.size()) {
       words.push_back(text.substr(start, end - start));
     }
     start = end == string_view::npos ? end : end + 1;
   }
   return words;
 }
+
+vector<string_view> SplitByQuotes(string_view text) {
+  vector<string_view> segments;
+  for (size_t start = 0; start <= text.size();) {
+    size_t end = text.find('"', start);
+    segments.push_back(text.substr(start, end == string_view::npos ? end : end - start));
+    start = end == string_view::npos ? end : end + 1;
+  }
+  return segments;
+}
@@ -6,6 +6,9 @@
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// Splits text on double quotes, segments with odd indices are the quoted ones
+std::vector<std::string_view> SplitByQuotes(std::string_view text);
+
 template<typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer &strings);
 
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Term frequencies are stored as doubles unless the build defines SEARCH_SERVER_TERM_FREQ_BITS
+// as 16, then they are quantized on a logarithmic scale to shrink every posting. Postings are
+// pair<const int, TermFreq>, padded to the alignment of int, so 16 bits is as small as a code
+// gets: an 8 bit code would be padded to the same 8 bytes and only lose precision
+
+// Term frequency in (0, 1] stored as a 16 bit code. Code 0 is zero, codes 1 .. max are spaced
+// logarithmically from MIN_TERM_FREQ to 1 with a whole number of codes per octave, so powers
+// of two are exact and the relative error is at most half a step, under 0.01%
+class QuantizedTermFreq {
+ public:
+  using Code = uint16_t;
+
+  static constexpr double MIN_TERM_FREQ = 1.0 / 65536;
+
+  QuantizedTermFreq() = default;
+
+  QuantizedTermFreq(double term_freq) : code_(Encode(term_freq)) {
+  }
+
+  operator double() const {
+    return GetDequantizationTable()[code_];
+  }
+
+ private:
+  static constexpr size_t CODE_COUNT = size_t{1} << (8 * sizeof(Code));
+  static constexpr size_t OCTAVE_COUNT = 16;
+  // Number of steps between the codes of MIN_TERM_FREQ and 1
+  static constexpr size_t STEP_COUNT = (CODE_COUNT - 2) / OCTAVE_COUNT * OCTAVE_COUNT;
+
+  Code code_ = 0;
+
+  static Code Encode(double term_freq) {
+    if (term_freq <= 0) {
+      return 0;
+    }
+    const double step = (std::log2(term_freq) + OCTAVE_COUNT) * (STEP_COUNT / OCTAVE_COUNT);
+    return static_cast<Code>(1 + std::clamp<long>(std::lround(step), 0, STEP_COUNT));
+  }
+
+  static const std::array<double, CODE_COUNT> &GetDequantizationTable() {
+    static const std::array<double, CODE_COUNT> table = [] {
+      std::array<double, CODE_COUNT> values{};
+      for (size_t code = 1; code < CODE_COUNT; ++code) {
+        values[code] = std::exp2((code - 1) * 1.0 / (STEP_COUNT / OCTAVE_COUNT) - OCTAVE_COUNT);
+      }
+      return values;
+    }();
+    return table;
+  }
+};
+
+#if !defined(SEARCH_SERVER_TERM_FREQ_BITS)
+using TermFreq = double;
+#elif SEARCH_SERVER_TERM_FREQ_BITS == 16
+using TermFreq = QuantizedTermFreq;
+#else
+#error "SEARCH_SERVER_TERM_FREQ_BITS must be 16"
+#endif
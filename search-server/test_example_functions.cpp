@@ -1,8 +1,17 @@
+#include "concurrent_map.h"
+#include "corpus_loader.h"
+#include "load_tester.h"
 #include "paginator.h"
+#include "process_queries.h"
+#include "segmented_index.h"
+#include "serving_index.h"
 #include "request_queue.h"
 //#include "remove_duplicates.h"
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 using namespace std;
@@ -201,6 +210,326 @@ void TestFindTopDocumentsByStatus() {
   ASSERT_EQUAL(found_docs[0].id, 10);
 }
 
+void TestSetDocumentStatus() {
+  SearchServer server = GetSearchServerForTesting();
+
+  server.SetDocumentStatus(29, DocumentStatus::IRRELEVANT);
+  const auto actual_docs = server.FindTopDocuments("cat and dog"s);
+  ASSERT_EQUAL(actual_docs.size(), 5u);
+  ASSERT_HINT(none_of(actual_docs.begin(), actual_docs.end(), [](const Document &document) {
+    return document.id == 29;
+  }), "Status change must move document out of the ACTUAL partition"s);
+
+  const auto irrelevant_docs =
+      server.FindTopDocuments(execution::par, "cat and dog"s, DocumentStatus::IRRELEVANT);
+  ASSERT_EQUAL(irrelevant_docs.size(), 1u);
+  ASSERT_EQUAL(irrelevant_docs[0].id, 29);
+
+  server.RemoveDocument(29);
+  ASSERT(server.FindTopDocuments("cat and dog"s, DocumentStatus::IRRELEVANT).empty());
+
+  try {
+    server.SetDocumentStatus(29, DocumentStatus::ACTUAL);
+    ASSERT_HINT(false, "Status of a missing document must not be set"s);
+  } catch (const out_of_range &) {
+  }
+}
+
+void TestFindTopDocumentsByFilterExpression() {
+  const SearchServer server = GetSearchServerForTesting();
+
+  const auto by_rating = server.FindTopDocuments(
+      "cat and dog"s, FilterExpression::RatingBetween(1, 2));
+  ASSERT_EQUAL(by_rating.size(), 3u);
+  for (const Document &document : by_rating) {
+    ASSERT(document.rating >= 1 && document.rating <= 2);
+  }
+
+  const auto filter = (FilterExpression::StatusIn({DocumentStatus::ACTUAL, DocumentStatus::BANNED})
+      && !FilterExpression::IdBetween(20, 50))
+      || FilterExpression::RatingBetween(-100, -1);
+  const auto by_filter = server.FindTopDocuments(execution::par, "cat and dog"s, filter);
+  const auto by_lambda = server.FindTopDocuments(
+      "cat and dog"s,
+      [](int document_id, DocumentStatus status, int rating) {
+        return ((status == DocumentStatus::ACTUAL || status == DocumentStatus::BANNED)
+            && !(document_id >= 20 && document_id <= 50)) || rating < 0;
+      });
+  ASSERT_EQUAL(by_filter.size(), by_lambda.size());
+  for (size_t i = 0; i < by_filter.size(); ++i) {
+    ASSERT_EQUAL(by_filter[i].id, by_lambda[i].id);
+  }
+
+  // Unbounded ranges must not overflow the upper bound
+  ASSERT_EQUAL(server.FindTopDocuments("cat and dog"s, FilterExpression::IdBetween(40, numeric_limits<int>::max())).size(),
+               server.FindTopDocuments("cat and dog"s, [](int document_id, DocumentStatus, int) {
+                 return document_id >= 40;
+               }).size());
+  ASSERT(server.FindTopDocuments("cat and dog"s, FilterExpression::IdBetween(0, -1)).empty());
+}
+
+void TestSparseDocumentIds() {
+  // Columns and bitmaps must not allocate per id below the largest one
+  const int max_id = numeric_limits<int>::max() - 1;
+  const vector<int> sparse_ids = {1, 2, max_id / 2, max_id};
+  const vector<string> texts = {"white cat"s, "fluffy cat fluffy tail"s, "groomed dog"s, "cat and dog"s};
+  SearchServer sparse_server(""s);
+  SearchServer dense_server(""s);
+  for (size_t i = 0; i < sparse_ids.size(); ++i) {
+    const int rating = static_cast<int>(i) - 1;
+    sparse_server.AddDocument(sparse_ids[i], texts[i], DocumentStatus::ACTUAL, {rating});
+    dense_server.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {rating});
+  }
+
+  const auto found_docs = sparse_server.FindTopDocuments<Bm25>(execution::seq, "cat dog"s);
+  const auto expected_docs = dense_server.FindTopDocuments<Bm25>(execution::seq, "cat dog"s);
+  ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+  for (size_t i = 0; i < found_docs.size(); ++i) {
+    ASSERT_EQUAL(found_docs[i].id, sparse_ids[expected_docs[i].id]);
+    ASSERT(abs(found_docs[i].relevance - expected_docs[i].relevance) < ERROR_MARGIN);
+    ASSERT_EQUAL(found_docs[i].rating, expected_docs[i].rating);
+  }
+
+  const auto by_rating = sparse_server.FindTopDocuments("cat dog"s, FilterExpression::RatingBetween(1, 2));
+  ASSERT_EQUAL(by_rating.size(), 2u);
+  ASSERT_EQUAL(by_rating[0].id, max_id / 2);
+  ASSERT_EQUAL(by_rating[1].id, max_id);
+  const auto by_id = sparse_server.FindTopDocuments(
+      "cat dog"s, FilterExpression::IdBetween(2, max_id / 2) || !FilterExpression::IdBetween(0, max_id - 1));
+  ASSERT_EQUAL(by_id.size(), 3u);
+  ASSERT(none_of(by_id.begin(), by_id.end(), [](const Document &document) {
+    return document.id == 1;
+  }));
+
+  sparse_server.RemoveDocument(max_id);
+  ASSERT_EQUAL(sparse_server.FindTopDocuments("cat dog"s).size(), 3u);
+  sparse_server.AddDocument(max_id, "dog"s, DocumentStatus::BANNED, {7});
+  const auto banned_docs = sparse_server.FindTopDocuments("dog"s, DocumentStatus::BANNED);
+  ASSERT_EQUAL(banned_docs.size(), 1u);
+  ASSERT_EQUAL(banned_docs[0].rating, 7);
+}
+
+void TestPhraseQuery() {
+  SearchServer server("in the"s);
+  server.EnablePositionalIndex();
+  server.AddDocument(1, "white cat in the big city"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "big white cat in the city"s, DocumentStatus::ACTUAL, {2});
+  server.AddDocument(3, "city cat and white dog"s, DocumentStatus::ACTUAL, {3});
+
+  {
+    const auto found_docs = server.FindTopDocuments("\"white cat\""s);
+    ASSERT_EQUAL(found_docs.size(), 2u);
+    ASSERT_EQUAL(found_docs[0].id, 2);
+    ASSERT_EQUAL(found_docs[1].id, 1);
+  }
+
+  {
+    const auto found_docs = server.FindTopDocuments(execution::par, "\"cat in the city\" -big"s);
+    ASSERT_EQUAL(found_docs.size(), 0u);
+    ASSERT_EQUAL(server.FindTopDocuments("\"cat in the city\""s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("\"cat the in city\""s).size(), 1u);
+    ASSERT(server.FindTopDocuments("\"cat city\""s).empty());
+  }
+
+  {
+    const string query = "\"white cat\" dog"s;
+    const auto [words, status] = server.MatchDocument(query, 3);
+    const vector<string_view> expected_words = {"dog"sv};
+    ASSERT_EQUAL(words, expected_words);
+  }
+
+  {
+    const string query = "\"white cat\" cat"s;
+    auto [words, status] = server.MatchDocument(execution::par, query, 1);
+    sort(words.begin(), words.end());
+    const vector<string_view> expected_words = {"cat"sv, "white"sv};
+    ASSERT_EQUAL(words, expected_words);
+  }
+
+  server.RemoveDocument(2);
+  ASSERT_EQUAL(server.FindTopDocuments("\"white cat\""s).size(), 1u);
+
+  try {
+    server.FindTopDocuments("\"white cat"s);
+    ASSERT_HINT(false, "Unclosed quote must be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+  try {
+    GetSearchServerForTesting().FindTopDocuments("\"white cat\""s);
+    ASSERT_HINT(false, "Phrases require positional index"s);
+  } catch (const invalid_argument &) {
+  }
+}
+
+void TestPrefixQuery() {
+  SearchServer server("in the"s);
+  server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "caterpillar on a cabbage"s, DocumentStatus::ACTUAL, {2});
+  server.AddDocument(3, "dog in the town"s, DocumentStatus::ACTUAL, {3});
+  server.AddDocument(4, "tiger and car"s, DocumentStatus::ACTUAL, {4});
+
+  {
+    const auto found_docs = server.FindTopDocuments("ca*"s);
+    ASSERT_EQUAL(found_docs.size(), 3u);
+    ASSERT_EQUAL(found_docs[0].id, 2);
+  }
+
+  {
+    const auto found_docs = server.FindTopDocuments(execution::par, "ca* -ti*"s);
+    ASSERT_EQUAL(found_docs.size(), 2u);
+    ASSERT(found_docs[0].id != 4 && found_docs[1].id != 4);
+  }
+
+  {
+    auto [words, status] = server.MatchDocument("cat*"s, 2);
+    const vector<string_view> expected_words = {"caterpillar"sv};
+    ASSERT_EQUAL(words, expected_words);
+    ASSERT(get<0>(server.MatchDocument(execution::par, "town -d*"s, 3)).empty());
+  }
+
+  try {
+    server.FindTopDocuments("cat *"s);
+    ASSERT_HINT(false, "Empty prefix must be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+}
+
+void TestFuzzyQuery() {
+  SearchServer server("in the"s);
+  server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "cart and horse"s, DocumentStatus::ACTUAL, {2});
+  server.AddDocument(3, "dog in the town"s, DocumentStatus::ACTUAL, {3});
+  server.AddDocument(4, "cast iron"s, DocumentStatus::ACTUAL, {4});
+
+  ASSERT(server.FindTopDocuments("citty"s).empty());
+  {
+    const auto found_docs = server.FindTopDocuments("citty~"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].id, 1);
+  }
+
+  {
+    const auto found_docs = server.FindTopDocuments(execution::par, "cat~2 -iron"s);
+    ASSERT_EQUAL(found_docs.size(), 2u);
+    ASSERT_EQUAL_HINT(found_docs[0].id, 1, "Exact match must outrank fuzzy ones"s);
+    ASSERT_EQUAL(found_docs[1].id, 2);
+  }
+
+  {
+    const string query = "dgo~2 tow~"s;
+    auto [words, status] = server.MatchDocument(query, 3);
+    sort(words.begin(), words.end());
+    const vector<string_view> expected_words = {"dog"sv, "town"sv};
+    ASSERT_EQUAL(words, expected_words);
+  }
+
+  try {
+    server.FindTopDocuments("cat -dog~"s);
+    ASSERT_HINT(false, "Minus fuzzy words must be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+}
+
+void TestPreparedQuery() {
+  SearchServer server = GetSearchServerForTesting();
+  const string raw_query = "dog town parrot -with"s;
+  SearchServer::PreparedQuery query = server.Prepare("cat"s);
+  {
+    const SearchServer::PreparedQuery prepared_query = server.Prepare(raw_query);
+    query = prepared_query;
+  }
+
+  PageRequest all;
+  all.limit = 100;
+  const auto expected_docs = server.FindTopDocuments(execution::seq, raw_query, DocumentStatus::ACTUAL, all);
+  const auto found_docs = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, all);
+  ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+  for (size_t i = 0; i < found_docs.size(); ++i) {
+    ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+  }
+  const auto [words, status] = server.MatchDocument(query, 3);
+  ASSERT_EQUAL(words, get<0>(server.MatchDocument(raw_query, 3)));
+  ASSERT(get<0>(server.MatchDocument(query, 19)).empty());
+
+  // Words indexed after Prepare are found too
+  server.AddDocument(100, "parrot in the town"s, DocumentStatus::ACTUAL, {1});
+  const auto docs_with_new_word = server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, all);
+  ASSERT_EQUAL(docs_with_new_word.size(), expected_docs.size() + 1);
+  ASSERT_EQUAL(docs_with_new_word[0].id, 100);
+  const SearchServer::PreparedQuery minus_query = server.Prepare("town -zebra"s);
+  const size_t town_document_count = server.FindTopDocuments(execution::seq, minus_query, DocumentStatus::ACTUAL, all).size();
+  server.AddDocument(101, "zebra town"s, DocumentStatus::ACTUAL, {1});
+  ASSERT_EQUAL(server.FindTopDocuments(execution::seq, minus_query, DocumentStatus::ACTUAL, all).size(), town_document_count);
+  server.RemoveDocument(101);
+
+  const SearchServer server_copy = server;
+  ASSERT_EQUAL(server_copy.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, all).size(), docs_with_new_word.size());
+
+  // Assignment frees the postings the query resolved, it has to resolve them again
+  SearchServer assigned("and"s);
+  assigned.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {1});
+  const SearchServer::PreparedQuery cat_query = assigned.Prepare("cat"s);
+  assigned = SearchServer(assigned);
+  ASSERT_EQUAL(assigned.FindTopDocuments(execution::seq, cat_query).size(), 1u);
+  SearchServer replacement("and"s);
+  replacement.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {1});
+  assigned = move(replacement);
+  const auto moved_docs = assigned.FindTopDocuments(execution::seq, cat_query);
+  ASSERT_EQUAL(moved_docs.size(), 1u);
+  ASSERT_EQUAL(moved_docs[0].id, 2);
+
+  // Analyzed words are views into the query's own text, the preparing server may be gone
+  const TextAnalyzer analyzer{AnalyzerOptions{}};
+  SearchServer::PreparedQuery analyzed_query;
+  {
+    SearchServer preparing("and"s);
+    preparing.SetTextAnalyzer(analyzer);
+    preparing.AddDocument(1, "fluffy cat"s, DocumentStatus::ACTUAL, {1});
+    analyzed_query = preparing.Prepare("FLUFFY, Cat -dog"s);
+  }
+  SearchServer running("and"s);
+  running.SetTextAnalyzer(analyzer);
+  running.AddDocument(3, "Fluffy cat"s, DocumentStatus::ACTUAL, {1});
+  running.AddDocument(4, "fluffy dog"s, DocumentStatus::ACTUAL, {1});
+  const auto analyzed_docs = running.FindTopDocuments(execution::seq, analyzed_query);
+  ASSERT_EQUAL(analyzed_docs.size(), 1u);
+  ASSERT_EQUAL(analyzed_docs[0].id, 3);
+  vector<string_view> matched_words = get<0>(running.MatchDocument(analyzed_query, 3));
+  analyzed_query = SearchServer::PreparedQuery();
+  sort(matched_words.begin(), matched_words.end());
+  ASSERT_EQUAL_HINT(vector<string>(matched_words.begin(), matched_words.end()),
+                    vector<string>({"cat"s, "fluffy"s}),
+                    "Matched words should outlive the query"s);
+}
+
+void TestFindTopDocumentsByImpact() {
+  SearchServer server = GetSearchServerForTesting();
+  try {
+    server.FindTopDocumentsByImpact("cat"s);
+    ASSERT_HINT(false, "Impact queries must require the impact index"s);
+  } catch (const invalid_argument &) {
+  }
+  server.BuildImpactIndex();
+
+  for (const string &query : {"cat city"s, "dog town -with"s, "city"s}) {
+    const auto expected_docs = server.FindTopDocuments(query);
+    const auto found_docs = server.FindTopDocumentsByImpact(query);
+    ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+    for (size_t i = 0; i < found_docs.size(); ++i) {
+      ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+      ASSERT_HINT(abs(found_docs[i].relevance - expected_docs[i].relevance) < ERROR_MARGIN, query);
+    }
+  }
+  ASSERT_EQUAL(server.FindTopDocumentsByImpact("cat city"s, DocumentStatus::ACTUAL, 1).size(), 1u);
+  ASSERT(server.FindTopDocumentsByImpact("cat"s, DocumentStatus::IRRELEVANT).empty());
+
+  server.RemoveDocument(29);
+  const auto found_docs = server.FindTopDocumentsByImpact("cat"s);
+  ASSERT(none_of(found_docs.begin(), found_docs.end(), [](const Document &document) {
+    return document.id == 29;
+  }));
+}
+
 void TestExcludeDocumentsWithMinusWordsFromFoundDocuments() {
   const SearchServer server = GetSearchServerForTesting();
 
@@ -219,6 +548,46 @@ void TestComputeRelevance() {
               "Should compute relevance correctly"s);
 }
 
+void TestComputeBm25Relevance() {
+  SearchServer server(""s);
+  server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "cat cat bird mouse"s, DocumentStatus::ACTUAL, {2});
+
+  {
+    const auto found_docs = server.FindTopDocuments<Bm25>(execution::seq, "dog"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    const double expected_relevance = log(2.0) * 2.2 / 1.9;
+    ASSERT_HINT(abs(found_docs[0].relevance - expected_relevance) < 1e-6,
+                "Should compute BM25 relevance correctly"s);
+  }
+
+  {
+    const auto found_docs = server.FindTopDocuments<Bm25>(execution::par, "cat"s);
+    ASSERT_EQUAL(found_docs.size(), 2u);
+    ASSERT_EQUAL(found_docs[0].id, 2);
+    ASSERT_HINT(abs(found_docs[0].relevance - log(1.2) * 4.4 / 3.5) < 1e-6,
+                "Longer documents must be normalized by the average length"s);
+  }
+
+  server.RemoveDocument(2);
+  const auto found_docs = server.FindTopDocuments<Bm25>(execution::seq, "dog"s);
+  const double expected_relevance = log(1.0 + 0.5 / 1.5) * 2.2 / 2.2;
+  ASSERT_HINT(abs(found_docs[0].relevance - expected_relevance) < 1e-6,
+              "Average length must follow removals"s);
+}
+
+void TestQuantizedTermFreq() {
+  ASSERT_EQUAL(static_cast<double>(QuantizedTermFreq(0.0)), 0.0);
+  ASSERT_EQUAL(static_cast<double>(QuantizedTermFreq(1.0)), 1.0);
+  ASSERT_HINT(QuantizedTermFreq(0.25) + QuantizedTermFreq(0.25) == 0.5, "Powers of two are exact"s);
+  for (const double term_freq : {1.0, 0.5, 1.0 / 3, 1.0 / 70, 1e-3}) {
+    const double quantized = QuantizedTermFreq(term_freq);
+    ASSERT_HINT(abs(quantized - term_freq) / term_freq < 1e-4, "Error is within half a step"s);
+  }
+  // Narrower codes would not shrink a posting, it is padded to the alignment of the id
+  ASSERT_EQUAL(sizeof(pair<const int, QuantizedTermFreq>), 2 * sizeof(int));
+}
+
 void TestComputeAverageRating() {
   SearchServer server(""s);
   const vector<int> ratings = {-10, 50, 1};
@@ -242,6 +611,42 @@ void TestSortByRelevance() {
   }
 }
 
+void TestFindTopDocumentsPage() {
+  const SearchServer server = GetSearchServerForTesting();
+  const string query = "cat and dog"s;
+
+  PageRequest all;
+  all.limit = 100;
+  const auto all_docs = server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, all);
+  ASSERT_EQUAL(all_docs.size(), 6u);
+
+  PageRequest second_page;
+  second_page.offset = 2;
+  second_page.limit = 2;
+  const auto page_docs = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, second_page);
+  ASSERT_EQUAL(page_docs.size(), 2u);
+  ASSERT_EQUAL(page_docs[0].id, all_docs[2].id);
+  ASSERT_EQUAL(page_docs[1].id, all_docs[3].id);
+
+  auto paginator = PaginateLazily<Document>(
+      [&server, &query](const optional<Document> &after) {
+        PageRequest page;
+        page.limit = 4;
+        page.after = after;
+        return server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, page);
+      });
+  vector<int> ids;
+  for (auto page = paginator.NextPage(); !page.empty(); page = paginator.NextPage()) {
+    for (const Document &document : page) {
+      ids.push_back(document.id);
+    }
+  }
+  ASSERT_EQUAL(ids.size(), all_docs.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ASSERT_EQUAL(ids[i], all_docs[i].id);
+  }
+}
+
 void TestGetDocumentCount() {
   const int doc_id1 = 42;
   const string content1 = "cat in the city"s;
@@ -286,6 +691,34 @@ void TestMatchDocument1() {
   }
 }
 
+void TestMatchDocuments() {
+  const SearchServer server = GetSearchServerForTesting();
+  const vector<int> document_ids = {19, 42, 3, 10, 42, 1};
+
+  for (const string &query : {"dog town -with"s, "cat cit* dogg~"s, "city"s}) {
+    const DocumentMatches seq_matches = server.MatchDocuments(query, document_ids);
+    const DocumentMatches par_matches = server.MatchDocuments(execution::par, query, document_ids);
+    ASSERT_EQUAL(seq_matches.offsets.size(), document_ids.size() + 1);
+    ASSERT_EQUAL(seq_matches.words, par_matches.words);
+    ASSERT_EQUAL(seq_matches.offsets, par_matches.offsets);
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+      const auto [words, status] = server.MatchDocument(query, document_ids[i]);
+      const vector<string_view> batch_words(seq_matches.words.begin() + seq_matches.offsets[i],
+                                            seq_matches.words.begin() + seq_matches.offsets[i + 1]);
+      ASSERT_EQUAL_HINT(batch_words, words, query);
+      ASSERT_EQUAL(static_cast<int>(seq_matches.statuses[i]), static_cast<int>(status));
+    }
+  }
+
+  bool is_thrown = false;
+  try {
+    server.MatchDocuments("dog"s, {1, 2});
+  } catch (const out_of_range &) {
+    is_thrown = true;
+  }
+  ASSERT_HINT(is_thrown, "Unknown document id should be reported"s);
+}
+
 void TestMatchDocumentWithMinusWords() {
   const SearchServer server = GetSearchServerForTesting();
 
@@ -295,6 +728,204 @@ void TestMatchDocumentWithMinusWords() {
   ASSERT_EQUAL(static_cast<int>(status), static_cast<int>(DocumentStatus::BANNED));
 }
 
+void TestQueryDeadline() {
+  const SearchServer server = GetSearchServerForTesting();
+  const QueryDeadline expired(QueryDeadline::Clock::now() - 1s);
+
+  {
+    const TopDocuments top_documents =
+        server.FindTopDocuments(execution::seq, "dog city -town"s, DocumentStatus::ACTUAL, {}, QueryDeadline(1h));
+    ASSERT(!top_documents.is_truncated);
+    const auto expected_docs = server.FindTopDocuments("dog city -town"s);
+    ASSERT_EQUAL(top_documents.documents.size(), expected_docs.size());
+    for (size_t i = 0; i < expected_docs.size(); ++i) {
+      ASSERT_EQUAL(top_documents.documents[i].id, expected_docs[i].id);
+    }
+  }
+  {
+    const TopDocuments top_documents =
+        server.FindTopDocuments(execution::par, "dog city"s, DocumentStatus::ACTUAL, {}, expired);
+    ASSERT_HINT(top_documents.is_truncated, "Expired deadline should truncate the results"s);
+    ASSERT(top_documents.documents.empty());
+  }
+  {
+    CancellationToken token;
+    const QueryDeadline deadline(token);
+    ASSERT(!server.FindTopDocuments(execution::seq, "dog"s, DocumentStatus::ACTUAL, {}, deadline).is_truncated);
+    token.Cancel();
+    ASSERT(server.FindTopDocuments(execution::seq, "dog"s, DocumentStatus::ACTUAL, {}, deadline).is_truncated);
+  }
+
+  {
+    const auto [words, status, is_truncated] = server.MatchDocument("dog without cat"s, 10, QueryDeadline());
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT(!is_truncated);
+  }
+  {
+    const auto [words, status, is_truncated] = server.MatchDocument("dog without cat"s, 10, expired);
+    ASSERT(words.empty());
+    ASSERT(is_truncated);
+  }
+  {
+    const auto [words, status, is_truncated] = server.MatchDocument("dog -cat"s, 10, expired);
+    ASSERT_HINT(words.empty() && !is_truncated, "Minus words are checked before the deadline"s);
+  }
+
+  const vector<TopDocuments> results = ProcessQueries(server, {"dog"s, "cat"s}, expired);
+  ASSERT(all_of(results.begin(), results.end(), [](const TopDocuments &result) {
+    return result.is_truncated && result.documents.empty();
+  }));
+}
+
+void TestRequestQueueAdmission() {
+  const SearchServer server = GetSearchServerForTesting();
+  {
+    RequestQueue request_queue(server);
+    const FindRequestResult result = request_queue.SubmitFindRequest("dog city"s);
+    ASSERT(!result.is_rejected);
+    ASSERT_EQUAL(result.documents.size(), server.FindTopDocuments("dog city"s).size());
+    request_queue.SubmitFindRequest("parrot"s, DocumentStatus::ACTUAL, RequestPriority::LOW);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+    const AdmissionStats stats = request_queue.GetAdmissionStats();
+    ASSERT_EQUAL(stats.admitted_counts[static_cast<int>(RequestPriority::NORMAL)], 1u);
+    ASSERT_EQUAL(stats.admitted_counts[static_cast<int>(RequestPriority::LOW)], 1u);
+    ASSERT(stats.total_service_time.count() > 0);
+  }
+  {
+    AdmissionOptions options;
+    options.target_service_time = chrono::microseconds(0);
+    RequestQueue request_queue(server, options);
+    for (int i = 0; i < 20; ++i) {
+      request_queue.SubmitFindRequest("dog city"s);
+    }
+    ASSERT_EQUAL_HINT(request_queue.GetAdmissionStats().concurrency_limit, 1.0,
+                      "Slow requests should shrink the limit to its minimum"s);
+  }
+  {
+    AdmissionOptions options;
+    options.target_service_time = chrono::hours(1);
+    options.max_concurrency = 5;
+    RequestQueue request_queue(server, options);
+    for (int i = 0; i < 100; ++i) {
+      request_queue.SubmitFindRequest("dog city"s);
+    }
+    ASSERT_EQUAL_HINT(request_queue.GetAdmissionStats().concurrency_limit, 5.0,
+                      "Fast requests should grow the limit to its maximum"s);
+  }
+  {
+    // A single slot and no wait queue, concurrent requests are either served or rejected
+    AdmissionOptions options;
+    options.queue_capacity = 0;
+    options.initial_concurrency = 1;
+    options.max_concurrency = 1;
+    RequestQueue request_queue(server, options);
+    vector<thread> clients;
+    for (int i = 0; i < 4; ++i) {
+      clients.emplace_back([&request_queue] {
+        for (int j = 0; j < 100; ++j) {
+          request_queue.SubmitFindRequest("dog city"s);
+        }
+      });
+    }
+    for (thread &client : clients) {
+      client.join();
+    }
+    const AdmissionStats stats = request_queue.GetAdmissionStats();
+    const uint64_t normal_admitted = stats.admitted_counts[static_cast<int>(RequestPriority::NORMAL)];
+    ASSERT_EQUAL(normal_admitted + stats.rejected_counts[static_cast<int>(RequestPriority::NORMAL)], 400u);
+    ASSERT(normal_admitted > 0);
+  }
+  AdmissionOptions invalid_options;
+  invalid_options.initial_concurrency = 0;
+  try {
+    RequestQueue request_queue(server, invalid_options);
+    ASSERT_HINT(false, "Concurrency limit below one must be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+}
+
+void TestRemoveDocumentWithTombstone() {
+  SearchServer server = GetSearchServerForTesting();
+  server.SetCompactionThreshold(1);
+  const auto docs_before = server.FindTopDocuments("cat"s);
+  ASSERT_EQUAL(docs_before[0].id, 29);
+
+  server.RemoveDocument(29);
+  const auto docs_after = server.FindTopDocuments("cat"s);
+  ASSERT(none_of(docs_after.begin(), docs_after.end(), [](const Document &document) {
+    return document.id == 29;
+  }));
+  ASSERT(server.GetWordFrequencies(29).empty());
+
+  // Reused id must not inherit postings of the removed document
+  server.AddDocument(29, "parrot"s, DocumentStatus::ACTUAL, {1});
+  ASSERT_EQUAL(server.GetWordFrequencies(29).size(), 1u);
+  ASSERT_EQUAL(server.FindTopDocuments("cat parrot"s, [](int id, DocumentStatus, int) {
+    return id == 29;
+  })[0].relevance, server.FindTopDocuments("parrot"s)[0].relevance);
+
+  server.RemoveDocument(42);
+  server.CompactPostings();
+  SearchServer expected_server = GetSearchServerForTesting();
+  expected_server.RemoveDocument(29);
+  expected_server.AddDocument(29, "parrot"s, DocumentStatus::ACTUAL, {1});
+  expected_server.RemoveDocument(42);
+  expected_server.CompactPostings();
+  const auto found_docs = server.FindTopDocuments("cat city"s);
+  const auto expected_docs = expected_server.FindTopDocuments("cat city"s);
+  ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+  for (size_t i = 0; i < found_docs.size(); ++i) {
+    ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+    ASSERT(abs(found_docs[i].relevance - expected_docs[i].relevance) < ERROR_MARGIN);
+  }
+
+  // Tombstoned postings must not count towards document frequencies before compaction
+  {
+    SearchServer tombstoned_server(""s);
+    SearchServer fresh_server(""s);
+    tombstoned_server.SetCompactionThreshold(1);
+    tombstoned_server.EnablePositionalIndex();
+    fresh_server.EnablePositionalIndex();
+    for (int id = 0; id < 10; ++id) {
+      const string text = id < 5 ? "cat dog"s : "cat"s;
+      tombstoned_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+      if (id != 0) {
+        fresh_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+      }
+    }
+    // A copy removes on its own posting lists, not on those of the server it was copied from
+    SearchServer copied_server = tombstoned_server;
+    tombstoned_server.RemoveDocument(0);
+    copied_server.RemoveDocument(0);
+    for (const string &query : {"cat dog"s, "cat do*"s, "cat dgo~"s, "\"cat dog\""s}) {
+      const auto expected_docs = fresh_server.FindTopDocuments(query);
+      for (const SearchServer *removed_server : {&tombstoned_server, &copied_server}) {
+        const auto found_docs = removed_server->FindTopDocuments(query);
+        ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+        for (size_t i = 0; i < found_docs.size(); ++i) {
+          ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+          ASSERT_HINT(abs(found_docs[i].relevance - expected_docs[i].relevance) < ERROR_MARGIN, query);
+        }
+      }
+    }
+    tombstoned_server.BuildImpactIndex();
+    fresh_server.BuildImpactIndex();
+    const auto found_docs = tombstoned_server.FindTopDocumentsByImpact("cat dog"s);
+    const auto expected_docs = fresh_server.FindTopDocumentsByImpact("cat dog"s);
+    ASSERT_EQUAL(found_docs.size(), expected_docs.size());
+    for (size_t i = 0; i < found_docs.size(); ++i) {
+      ASSERT_EQUAL(found_docs[i].id, expected_docs[i].id);
+      ASSERT(abs(found_docs[i].relevance - expected_docs[i].relevance) < ERROR_MARGIN);
+    }
+  }
+
+  try {
+    server.SetCompactionThreshold(0);
+    ASSERT_HINT(false, "Zero garbage ratio must be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+}
+
 void TestSplitIntoWords() {
   {
     const vector<string> expected_words = {};
@@ -316,17 +947,510 @@ void TestSplitIntoWords() {
   }
 }
 
+void TestStopWordSet() {
+  ASSERT(!StopWordSet().Contains("in"s));
+  vector<string> dictionary;
+  for (int i = 0; i < 1000; ++i) {
+    dictionary.push_back(string(1, static_cast<char>('a' + i % 26)) + to_string(i * 7919 % 1000));
+  }
+  const set<string, less<>> words(dictionary.begin(), dictionary.begin() + 500);
+  const StopWordSet stop_words(words);
+  ASSERT_EQUAL(stop_words.size(), words.size());
+  for (const string &word : dictionary) {
+    ASSERT_EQUAL_HINT(stop_words.Contains(word), words.count(word) > 0, word);
+    ASSERT_HINT(!stop_words.Contains(word + "s"s), word);
+    ASSERT_HINT(!stop_words.Contains(string_view(word).substr(1)) || words.count(word.substr(1)), word);
+  }
+  ASSERT(!stop_words.Contains(""s));
+  ASSERT(!stop_words.Contains(string(100, 'a')));
+}
+
+void TestTextAnalyzer() {
+  const TextAnalyzer analyzer{AnalyzerOptions{}};
+  ASSERT(TextAnalyzer().IsIdentity());
+  ASSERT_EQUAL(TextAnalyzer().Normalize("Cat, DOG!"s), "Cat, DOG!"s);
+  ASSERT_EQUAL(analyzer.Normalize("Cat, DOG! e-mail"s), "cat  dog  e mail"s);
+  // Long enough for whole blocks, with a multibyte character inside one of them
+  ASSERT_EQUAL(analyzer.Normalize("The QUICK brown Fox (jumps) over the LAZY КОТ and Dog."s),
+               "the quick brown fox  jumps  over the lazy КОТ and dog "s);
+  AnalyzerOptions fold_options;
+  fold_options.fold_utf8_case = true;
+  ASSERT_EQUAL(TextAnalyzer(fold_options).Normalize("КОТ Ёж ÀB"s),
+               "кот ёж àb"s);
+  ASSERT_EQUAL(analyzer.NormalizeQuery("-Cat* \"Big, DOG\" dogg~1 e-mail ~x"s),
+               "-cat* \"big  dog\" dogg~1 e mail  x"s);
+
+  SearchServer server("In the"s);
+  server.EnablePositionalIndex();
+  server.SetTextAnalyzer(analyzer);
+  server.AddDocument(1, "Cat, in THE City."s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "Dog in the town"s, DocumentStatus::ACTUAL, {2});
+  ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 2u);
+  const auto found_docs = server.FindTopDocuments("CAT? -Town"s);
+  ASSERT_EQUAL(found_docs.size(), 1u);
+  ASSERT_EQUAL(found_docs[0].id, 1);
+  ASSERT_EQUAL(server.FindTopDocuments("\"cat, in the CITY\""s).size(), 1u);
+  ASSERT_EQUAL(server.FindTopDocuments("Ci*"s).size(), 1u);
+  vector<string_view> words;
+  {
+    const string query = "City! Cat DOG"s;
+    words = get<0>(server.MatchDocument(query, 1));
+  }
+  ASSERT_EQUAL_HINT(vector<string>(words.begin(), words.end()), vector<string>({"cat"s, "city"s}),
+                    "Matched words should outlive the query"s);
+  try {
+    server.SetTextAnalyzer(TextAnalyzer());
+    ASSERT_HINT(false, "Analyzer cannot change once documents are added"s);
+  } catch (const invalid_argument &) {
+  }
+}
+
+void TestTracer() {
+  SearchServer server = GetSearchServerForTesting();
+  Tracer::Clear();
+  server.FindTopDocuments("cat"s);
+  ASSERT_EQUAL_HINT(Tracer::GetEventCount(), 0u, "Nothing is recorded until the tracer starts"s);
+
+  Tracer::Start();
+  server.FindTopDocuments(execution::par, "dog city -town"s);
+  ProcessQueries(server, {"cat"s, "dog"s});
+  server.RemoveDocument(1);
+  server.CompactPostings();
+  Tracer::Stop();
+  const size_t event_count = Tracer::GetEventCount();
+  server.FindTopDocuments("cat"s);
+  ASSERT_EQUAL(Tracer::GetEventCount(), event_count);
+
+  ostringstream trace;
+  Tracer::WriteChromeTrace(trace);
+  const string json = trace.str();
+  ASSERT(json.rfind("{\"traceEvents\":["s, 0) == 0);
+  for (const string &name : {"FindAllDocuments plus word"s, "FindAllDocuments minus word"s, "ConcurrentHashMap drain"s,
+                            "SelectPage"s, "ProcessQueries query"s, "RemoveDocument"s, "CompactPostings word"s}) {
+    ASSERT_HINT(json.find("\"name\":\""s + name + "\""s) != string::npos, name);
+  }
+  ASSERT(json.find("\"ph\":\"X\""s) != string::npos && json.find("e+"s) == string::npos);
+  Tracer::Clear();
+  ASSERT_EQUAL(Tracer::GetEventCount(), 0u);
+}
+
+void TestConcurrentMap() {
+  ASSERT_EQUAL((ConcurrentMap<int, int>::ChooseBucketCount(10, 8)), 10u);
+  ASSERT_EQUAL((ConcurrentMap<int, int>::ChooseBucketCount(100'000, 4)), 4 * CONCURRENT_MAP_BUCKETS_PER_THREAD);
+  ASSERT_EQUAL((ConcurrentMap<int, int>::ChooseBucketCount(0, 0)), 1u);
+
+  ConcurrentMap<int, int> concurrent_map(64);
+  ASSERT(concurrent_map.GetContentionStats().empty());
+  concurrent_map.EnableContentionStats();
+  // Multiples of the bucket count used to share one bucket
+  for (int i = 0; i < 1000; ++i) {
+    concurrent_map[i * 64].ref_to_value += i;
+  }
+  concurrent_map.erase(0);
+  const auto stats = concurrent_map.GetContentionStats();
+  ASSERT_EQUAL(stats.size(), 64u);
+  uint64_t acquire_count = 0;
+  uint64_t max_acquire_count = 0;
+  for (const BucketContention &bucket : stats) {
+    acquire_count += bucket.acquire_count;
+    max_acquire_count = max(max_acquire_count, bucket.acquire_count);
+    ASSERT_EQUAL(bucket.contended_count, 0u);
+  }
+  ASSERT_EQUAL(acquire_count, 1001u);
+  ASSERT_HINT(max_acquire_count < 50, "Keys should be spread over the buckets"s);
+  const auto ordinary_map = concurrent_map.BuildOrdinaryMap();
+  ASSERT_EQUAL(ordinary_map.size(), 999u);
+  ASSERT_EQUAL(ordinary_map.at(64 * 999), 999);
+}
+
+void TestConcurrentHashMap() {
+  ConcurrentHashMap<int, double> concurrent_map(1000);
+  ASSERT_EQUAL(concurrent_map.GetCapacity(), 2048u);
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&concurrent_map] {
+      for (int i = 0; i < 1000; ++i) {
+        concurrent_map.FetchAdd(i * 64, 0.5);
+      }
+    });
+  }
+  for (thread &worker : threads) {
+    worker.join();
+  }
+  concurrent_map.Erase(0);
+  concurrent_map.Erase(-1);
+  concurrent_map.FetchAdd(0, 1);
+  auto entries = concurrent_map.Drain(execution::par);
+  ASSERT_EQUAL(entries.size(), 999u);
+  sort(entries.begin(), entries.end());
+  ASSERT_EQUAL(entries.front().first, 64);
+  ASSERT_EQUAL(entries.back().first, 64 * 999);
+  ASSERT(all_of(entries.begin(), entries.end(), [](const pair<int, double> &entry) {
+    return entry.second == 2;
+  }));
+  ASSERT_EQUAL(concurrent_map.Drain(execution::seq).size(), 999u);
+
+  ConcurrentHashMap<string, int> word_counts(2);
+  word_counts.FetchAdd("cat"s, 1);
+  word_counts.FetchAdd("dog"s, 2);
+  word_counts.FetchAdd("cat"s, 3);
+  try {
+    word_counts.FetchAdd("rat"s, 1);
+    word_counts.FetchAdd("owl"s, 1);
+    word_counts.FetchAdd("eel"s, 1);
+    ASSERT_HINT(false, "Map over capacity should throw"s);
+  } catch (const length_error &) {
+  }
+  const auto counts = word_counts.Drain(execution::seq);
+  ASSERT_EQUAL((map<string, int>(counts.begin(), counts.end()).at("cat"s)), 4);
+}
+
+void TestLoadCorpus() {
+  const string path = (filesystem::temp_directory_path() / "search_server_test_corpus.tsv"s).string();
+  {
+    ofstream out(path);
+    out << "1\tACTUAL\t1 2 3\twhite cat and fancy collar\r\n"s
+        << "\n"s
+        << "2\tBANNED\t-4\tfluffy cat fluffy tail\n"s
+        << "3\tACTUAL\t\tgroomed dog expressive eyes"s;
+  }
+  {
+    SearchServer server("and in on"s);
+    const IngestReport report = LoadCorpus(server, path, 2);
+    ASSERT_EQUAL(report.document_count, 3u);
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    const auto [words, status] = server.MatchDocument("fluffy cat"s, 2);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT_EQUAL(static_cast<int>(status), static_cast<int>(DocumentStatus::BANNED));
+    const auto found_docs = server.FindTopDocuments("collar"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].rating, 2);
+  }
+  {
+    ofstream out(path);
+    out << "1\tACTUAL\t1\tcat\n"s
+        << "2\tUNKNOWN\t1\tdog\n"s
+        << "3\tACTUAL\t1\tbird\n"s;
+  }
+  {
+    SearchServer server("and in on"s);
+    bool is_thrown = false;
+    try {
+      LoadCorpus(server, path, 2);
+    } catch (const invalid_argument &) {
+      is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "Invalid line should be reported"s);
+    ASSERT_HINT(server.GetDocumentCount() == 1, "Lines before the invalid one should be indexed"s);
+  }
+  {
+    // Far more lines than the parser may run ahead of the inserter
+    ofstream out(path);
+    for (int id = 0; id < 1000; ++id) {
+      out << id << "\tACTUAL\t1\tcat number"s << id << '\n';
+    }
+  }
+  {
+    SearchServer server("and in on"s);
+    ASSERT_EQUAL(LoadCorpus(server, path, 1).document_count, 1000u);
+    ASSERT_EQUAL(server.FindTopDocuments("number999"s).size(), 1u);
+  }
+  filesystem::remove(path);
+}
+
+void TestLoadTester() {
+  SearchServer server("and in on"s);
+  server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {2});
+  const string path = (filesystem::temp_directory_path() / "search_server_test_queries.log"s).string();
+  {
+    ofstream out(path);
+    out << "cat\r\n"s
+        << "\n"s
+        << "parrot\n"s
+        << "--cat\n"s
+        << "fluffy"s;
+  }
+  const vector<string> queries = ReadQueryLog(path);
+  filesystem::remove(path);
+  ASSERT_EQUAL(queries, (vector<string>{"cat"s, "parrot"s, "--cat"s, "fluffy"s}));
+
+  LoadTestOptions options;
+  options.client_count = 2;
+  options.request_count = 40;
+  const LoadTestReport closed_loop = RunLoadTest(server, queries, options);
+  ASSERT_EQUAL(closed_loop.served_count, 30u);
+  ASSERT_EQUAL(closed_loop.error_count, 10u);
+  ASSERT_EQUAL(closed_loop.rejected_count, 0u);
+  ASSERT(abs(closed_loop.empty_result_rate - 1.0 / 3) < 1e-9);
+  ASSERT(closed_loop.throughput > 0);
+  ASSERT(closed_loop.latency.p50 <= closed_loop.latency.p99 && closed_loop.latency.p99 <= closed_loop.latency.max);
+
+  options.mode = LoadMode::OPEN_LOOP;
+  options.arrival_rate = 20'000;
+  const LoadTestReport open_loop = RunLoadTest(server, queries, options);
+  ASSERT_EQUAL(open_loop.served_count, 30u);
+  // Corrected latency also counts the wait for the scheduled send
+  ASSERT(open_loop.latency.p99 >= open_loop.uncorrected_latency.p99);
+  ASSERT(open_loop.wall_seconds >= 39 / options.arrival_rate);
+
+  options.arrival_rate = 0;
+  try {
+    RunLoadTest(server, queries, options);
+    ASSERT_HINT(false, "Zero arrival rate should be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+  try {
+    RunLoadTest(server, {}, {});
+    ASSERT_HINT(false, "Empty query log should be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+}
+
+void TestServingIndex() {
+  auto first = make_unique<SearchServer>("and in on"s);
+  first->AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {1});
+  ServingIndex index(move(first));
+  ASSERT_EQUAL(index.GetVersion(), 1u);
+  try {
+    ServingIndex empty_index(nullptr);
+    ASSERT_HINT(false, "Null initial server must be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+  ServingIndex::Handle in_flight = index.Acquire();
+  const weak_ptr<const SearchServer> first_version = in_flight;
+
+  auto second = make_unique<SearchServer>("and in on"s);
+  second->AddDocument(2, "fluffy dog"s, DocumentStatus::ACTUAL, {1});
+  ASSERT_EQUAL(index.Publish(move(second)), 2u);
+  ASSERT(index.FindTopDocuments("cat"s).empty());
+  ASSERT_EQUAL(index.FindTopDocuments("dog"s).size(), 1u);
+  // Query started before the swap still sees its version
+  ASSERT_EQUAL(in_flight->FindTopDocuments("cat"s).size(), 1u);
+  in_flight.reset();
+  index.WaitForReclamation();
+  ASSERT(first_version.expired());
+
+  const string path = (filesystem::temp_directory_path() / "search_server_test_serving.tsv"s).string();
+  ofstream(path) << "3\tACTUAL\t5\tgreen parrot\n"s;
+  ASSERT_EQUAL(index.LoadCorpusAsync("and in on"s, path).get(), 3u);
+  filesystem::remove(path);
+  ASSERT_EQUAL(index.FindTopDocuments("parrot"s).size(), 1u);
+
+  // Failed build leaves the serving version in place
+  auto failed = index.RebuildAsync([]() -> unique_ptr<SearchServer> {
+    throw invalid_argument("Broken corpus"s);
+  });
+  try {
+    failed.get();
+    ASSERT_HINT(false, "Build error should reach the future"s);
+  } catch (const invalid_argument &) {
+  }
+  try {
+    index.Publish(nullptr);
+    ASSERT_HINT(false, "Null search server should be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+  ASSERT_EQUAL(index.GetVersion(), 3u);
+  ASSERT_EQUAL(index.FindTopDocuments("parrot"s).size(), 1u);
+}
+
+void TestAutoExecution() {
+  SearchServer server("and in on"s);
+  server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {2});
+  server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {3});
+  server.AddDocument(4, "fluffy dog"s, DocumentStatus::BANNED, {4});
+  const string raw_query = "fluffy cat dog -collar"s;
+
+  // Default thresholds keep a toy query sequential
+  ASSERT_EQUAL(server.ChooseThreadCount(raw_query), 1u);
+  const auto get_ids = [](const vector<Document> &documents) {
+    vector<int> ids;
+    for (const Document &document : documents) {
+      ids.push_back(document.id);
+    }
+    return ids;
+  };
+  const vector<int> expected_ids = get_ids(server.FindTopDocuments(execution::seq, raw_query));
+  ASSERT_EQUAL(expected_ids, (vector<int>{2, 3}));
+  ASSERT_EQUAL(get_ids(server.FindTopDocuments(auto_execution, raw_query)), expected_ids);
+
+  ExecutionCalibration calibration;
+  calibration.min_parallel_posting_count = 4;
+  calibration.postings_per_thread = 2;
+  calibration.max_thread_count = 8;
+  server.SetExecutionCalibration(calibration);
+  // 7 postings pay for 3 threads, one per plus word
+  ASSERT_EQUAL(server.ChooseThreadCount(raw_query), 3u);
+  ASSERT_EQUAL(server.ChooseThreadCount("cat"s), 1u);
+  // Prefixes and fuzzy words count the postings of their expansions, not every document
+  ASSERT_EQUAL(server.ChooseThreadCount("fa* gr*"s), 1u);
+  ASSERT_EQUAL(server.ChooseThreadCount("flu* gr* dof~"s), 2u);
+  ASSERT_EQUAL(get_ids(server.FindTopDocuments(auto_execution, "flu* gr* dof~"s)),
+               get_ids(server.FindTopDocuments(execution::seq, "flu* gr* dof~"s)));
+  ASSERT_EQUAL(get_ids(server.FindTopDocuments(auto_execution, raw_query)), expected_ids);
+  ASSERT_EQUAL(server.FindTopDocuments(auto_execution, raw_query, DocumentStatus::BANNED).size(), 1u);
+  const auto truncated = server.FindTopDocuments(auto_execution, raw_query, DocumentStatus::ACTUAL, {},
+                                                 QueryDeadline(chrono::steady_clock::now()));
+  ASSERT(truncated.is_truncated);
+
+  calibration.postings_per_thread = 0;
+  try {
+    server.SetExecutionCalibration(calibration);
+    ASSERT_HINT(false, "Zero postings per thread should be rejected"s);
+  } catch (const invalid_argument &) {
+  }
+  const ExecutionCalibration measured = server.CalibrateExecution();
+  ASSERT_EQUAL(measured.max_thread_count, server.GetExecutionCalibration().max_thread_count);
+  ASSERT_EQUAL(get_ids(server.FindTopDocuments(auto_execution, raw_query)), expected_ids);
+}
+
+void TestPartitionedExecution() {
+  SearchServer server("and in on the"s);
+  server.EnablePositionalIndex();
+  const vector<string> texts = {
+      "white cat and fancy collar"s,
+      "fluffy cat fluffy tail"s,
+      "groomed dog expressive eyes"s,
+      "fluffy dog in the city"s,
+      "big cat in the city"s,
+      "catfish and cats"s,
+      "fluffy fluffy fluffy"s,
+  };
+  // Sparse ids, so that some partitions are empty
+  const vector<int> ids = {0, 3, 17, 18, 400, 401, 1000};
+  for (size_t i = 0; i < texts.size(); ++i) {
+    server.AddDocument(ids[i], texts[i], i == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {static_cast<int>(i)});
+  }
+  server.RemoveDocument(17);
+
+  PageRequest all;
+  all.limit = numeric_limits<size_t>::max();
+  for (const string &raw_query : {"fluffy cat dog"s, "fluffy -tail"s, "\"in the city\" cat"s, "cat* -catfish"s,
+                                  "fluffi~ dog"s, "cat -ca*"s}) {
+    const auto expected = server.FindTopDocuments(execution::seq, raw_query, DocumentStatus::ACTUAL, all);
+    for (const size_t partition_count : {size_t{1}, size_t{3}, size_t{7}, size_t{5000}}) {
+      const auto found = server.FindTopDocuments(PartitionedExecutionPolicy{partition_count}, raw_query,
+                                                 DocumentStatus::ACTUAL, all);
+      ASSERT_EQUAL_HINT(found.size(), expected.size(), raw_query);
+      for (size_t i = 0; i < found.size(); ++i) {
+        ASSERT_EQUAL_HINT(found[i].id, expected[i].id, raw_query);
+        // Same terms in the same order, so the sums are bit for bit equal
+        ASSERT_HINT(found[i].relevance == expected[i].relevance, raw_query);
+      }
+    }
+  }
+
+  // Every partition keeps offset + limit documents, enough for any page
+  PageRequest page;
+  page.offset = 1;
+  page.limit = 2;
+  const auto expected_page = server.FindTopDocuments(execution::seq, "fluffy cat city"s, DocumentStatus::ACTUAL, page);
+  const auto found_page = server.FindTopDocuments(PartitionedExecutionPolicy{3}, "fluffy cat city"s,
+                                                  DocumentStatus::ACTUAL, page);
+  ASSERT_EQUAL(found_page.size(), 2u);
+  ASSERT_EQUAL(found_page[0].id, expected_page[0].id);
+  ASSERT_EQUAL(found_page[1].id, expected_page[1].id);
+  page.offset = 0;
+  page.after = found_page[0];
+  const auto after_cursor = server.FindTopDocuments(partitioned_execution, "fluffy cat city"s,
+                                                    DocumentStatus::ACTUAL, page);
+  ASSERT_EQUAL(after_cursor[0].id, found_page[1].id);
+
+  ASSERT_EQUAL(server.FindTopDocuments(partitioned_execution, "dog"s, DocumentStatus::BANNED).size(), 1u);
+  ASSERT(server.FindTopDocuments(partitioned_execution, "fluffy"s, DocumentStatus::ACTUAL, {},
+                                 QueryDeadline(chrono::steady_clock::now())).is_truncated);
+  ASSERT(SearchServer("and"s).FindTopDocuments(partitioned_execution, "cat"s).empty());
+}
+
+void TestSegmentedIndex() {
+  SearchServer server("in the and"s);
+  SegmentedIndex index("in the and"s, 2);
+  const vector<string> documents = {
+      "cat in the city"s, "dog in the city"s, "dog in the town"s, "dog and cat"s,
+      "dog and cat in the city"s, "dog and cat in the town cat"s, "white parrot"s,
+      "dog with cat in the town in city"s, "fluffy cat"s, "groomed dog"s,
+  };
+  for (size_t i = 0; i < documents.size(); ++i) {
+    const DocumentStatus status = i == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+    server.AddDocument(i, documents[i], status, {static_cast<int>(i)});
+    index.AddDocument(i, documents[i], status, {static_cast<int>(i)});
+  }
+  ASSERT_EQUAL(index.GetDocumentCount(), server.GetDocumentCount());
+  ASSERT(index.GetSegmentCount() > 0);
+
+  const auto assert_same_results = [&server, &index](const string &query, DocumentStatus status) {
+    const auto expected_docs = server.FindTopDocuments(query, status);
+    const auto found_docs = index.FindTopDocuments(query, status);
+    ASSERT_EQUAL_HINT(found_docs.size(), expected_docs.size(), query);
+    for (size_t i = 0; i < found_docs.size(); ++i) {
+      ASSERT_EQUAL_HINT(found_docs[i].id, expected_docs[i].id, query);
+      ASSERT_HINT(abs(found_docs[i].relevance - expected_docs[i].relevance) < ERROR_MARGIN, query);
+    }
+  };
+  assert_same_results("cat city"s, DocumentStatus::ACTUAL);
+  assert_same_results("dog -town"s, DocumentStatus::ACTUAL);
+  assert_same_results("cat"s, DocumentStatus::BANNED);
+
+  for (const int id : {0, 4, 5, 8}) {
+    server.RemoveDocument(id);
+    index.RemoveDocument(id);
+  }
+  index.AddDocument(4, "cat in a hat"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(4, "cat in a hat"s, DocumentStatus::ACTUAL, {1});
+  index.WaitForMerges();
+  ASSERT_EQUAL(index.GetDocumentCount(), server.GetDocumentCount());
+  assert_same_results("cat city"s, DocumentStatus::ACTUAL);
+  assert_same_results("dog cat -parrot"s, DocumentStatus::ACTUAL);
+  // Literal words with these characters still match, the query forms SearchServer expands do not
+  assert_same_results("cat~x dog"s, DocumentStatus::ACTUAL);
+  for (const string &query : {"ca*"s, "cat~"s, "-cat~2"s, "\"dog cat\""s}) {
+    try {
+      index.FindTopDocuments(query, DocumentStatus::ACTUAL);
+      ASSERT_HINT(false, query);
+    } catch (const invalid_argument &) {
+    }
+  }
+}
+
 // Launch tests
 void TestSearchServer() {
   RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
   RUN_TEST(TestFindTopDocuments);
   RUN_TEST(TestFindTopDocumentsByLambda);
   RUN_TEST(TestFindTopDocumentsByStatus);
+  RUN_TEST(TestSetDocumentStatus);
+  RUN_TEST(TestFindTopDocumentsByFilterExpression);
+  RUN_TEST(TestSparseDocumentIds);
+  RUN_TEST(TestPhraseQuery);
+  RUN_TEST(TestPrefixQuery);
+  RUN_TEST(TestFuzzyQuery);
   RUN_TEST(TestGetDocumentCount);
+  RUN_TEST(TestFindTopDocumentsPage);
   RUN_TEST(TestMatchDocument1);
   RUN_TEST(TestMatchDocumentWithMinusWords);
+  RUN_TEST(TestMatchDocuments);
+  RUN_TEST(TestQueryDeadline);
+  RUN_TEST(TestRequestQueueAdmission);
+  RUN_TEST(TestPreparedQuery);
+  RUN_TEST(TestFindTopDocumentsByImpact);
+  RUN_TEST(TestRemoveDocumentWithTombstone);
   RUN_TEST(TestSplitIntoWords);
+  RUN_TEST(TestStopWordSet);
+  RUN_TEST(TestTextAnalyzer);
+  RUN_TEST(TestTracer);
+  RUN_TEST(TestConcurrentMap);
+  RUN_TEST(TestConcurrentHashMap);
+  RUN_TEST(TestLoadTester);
+  RUN_TEST(TestServingIndex);
+  RUN_TEST(TestAutoExecution);
+  RUN_TEST(TestPartitionedExecution);
+  RUN_TEST(TestLoadCorpus);
+  RUN_TEST(TestSegmentedIndex);
   RUN_TEST(TestComputeRelevance);
+  RUN_TEST(TestComputeBm25Relevance);
+  RUN_TEST(TestQuantizedTermFreq);
   RUN_TEST(TestComputeAverageRating);
   RUN_TEST(TestSortByRelevance);
   RUN_TEST(TestExcludeDocumentsWithMinusWordsFromFoundDocuments);
@@ -510,6 +1634,23 @@ void TestRemoveDocument() {
 
     TestRemoveDocumentWithoutPolicy("plain", search_server);
   }
+
+  {
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+      search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    search_server.SetCompactionThreshold(1);
+
+    // Batch purge, postings are compacted once at the end
+    LOG_DURATION("batch purge"s);
+    const int document_count = search_server.GetDocumentCount();
+    for (int id = 0; id < document_count; ++id) {
+      search_server.RemoveDocument(id);
+    }
+    search_server.CompactPostings();
+    cout << search_server.GetDocumentCount() << endl;
+  }
 }
 
 template<typename ExecutionPolicy>
@@ -543,6 +1684,30 @@ void TestMatchDocument2() {
 
   TEST_MATCH_DOCUMENT(seq);
   TEST_MATCH_DOCUMENT(par);
+
+  // Highlighting a page of results
+  vector<int> page_ids;
+  for (int id = 0; id < 1000; id += 10) {
+    page_ids.push_back(id);
+  }
+  {
+    LOG_DURATION("page MatchDocument"s);
+    size_t word_count = 0;
+    for (int i = 0; i < 100; ++i) {
+      for (int id : page_ids) {
+        word_count += get<0>(search_server.MatchDocument(query, id)).size();
+      }
+    }
+    cout << word_count << endl;
+  }
+  {
+    LOG_DURATION("page MatchDocuments"s);
+    size_t word_count = 0;
+    for (int i = 0; i < 100; ++i) {
+      word_count += search_server.MatchDocuments(query, page_ids).words.size();
+    }
+    cout << word_count << endl;
+  }
 }
 
 template<typename ExecutionPolicy>
@@ -573,3 +1738,827 @@ void TestFindTopDocuments2() {
   TEST_FIND_TOP_DOCUMENTS(seq);
   TEST_FIND_TOP_DOCUMENTS(par);
 }
+
+void TestFindTopDocumentsByRatingFilter() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 1000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    const int rating = uniform_int_distribution(-10, 10)(generator);
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {rating});
+  }
+  const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+  {
+    LOG_DURATION("lambda"s);
+    double total_relevance = 0;
+    for (const string_view query : queries) {
+      const auto found_docs = search_server.FindTopDocuments(
+          query,
+          [](int, DocumentStatus, int rating) {
+            return rating >= 0 && rating <= 5;
+          });
+      for (const auto &document : found_docs) {
+        total_relevance += document.relevance;
+      }
+    }
+    cout << total_relevance << endl;
+  }
+  {
+    LOG_DURATION("filter expression"s);
+    double total_relevance = 0;
+    for (const string_view query : queries) {
+      const auto found_docs =
+          search_server.FindTopDocuments(query, FilterExpression::RatingBetween(0, 5));
+      for (const auto &document : found_docs) {
+        total_relevance += document.relevance;
+      }
+    }
+    cout << total_relevance << endl;
+  }
+}
+
+void TestPhraseQueryBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 1000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10000, 70);
+  SearchServer search_server(dictionary[0]);
+  search_server.EnablePositionalIndex();
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  size_t word_count = 0;
+  for (const string &document : documents) {
+    word_count += SplitIntoWords(document).size();
+  }
+  cout << "positional index: "s << search_server.GetPositionalIndexByteSize() << " bytes for "s
+       << word_count << " words"s << endl;
+
+  // Phrases are cut from the documents, so every query has at least one match
+  vector<string> phrases;
+  vector<string> plain_queries;
+  for (int i = 0; i < 100; ++i) {
+    const auto words = SplitIntoWords(documents[i * 97 % documents.size()]);
+    const size_t length = min<size_t>(3, words.size());
+    string phrase;
+    for (size_t j = 0; j < length; ++j) {
+      phrase += (j ? " "s : ""s) + string(words[j]);
+    }
+    plain_queries.push_back(phrase);
+    phrases.push_back("\""s + phrase + "\""s);
+  }
+  TestFindTopDocumentsWithPolicy("words"sv, search_server, plain_queries, execution::seq);
+  TestFindTopDocumentsWithPolicy("phrase"sv, search_server, phrases, execution::seq);
+}
+
+void TestFuzzyQueryBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 300'000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10'000, 100);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  // Every query word has one character replaced
+  vector<string> queries;
+  for (const string &query : GenerateQueries(generator, dictionary, 100, 3)) {
+    string fuzzy_query;
+    for (const string_view word : SplitIntoWords(query)) {
+      string misspelled(word);
+      misspelled[uniform_int_distribution<size_t>(0, word.size() - 1)(generator)] = 'z';
+      fuzzy_query += misspelled + "~ "s;
+    }
+    queries.push_back(fuzzy_query);
+  }
+  TestFindTopDocumentsWithPolicy("fuzzy"sv, search_server, queries, execution::seq);
+}
+
+void TestScoringModelBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 1000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+  {
+    LOG_DURATION("tf-idf"s);
+    double total_relevance = 0;
+    for (const string_view query : queries) {
+      for (const auto &document : search_server.FindTopDocuments<TfIdf>(execution::seq, query)) {
+        total_relevance += document.relevance;
+      }
+    }
+    cout << total_relevance << endl;
+  }
+  {
+    LOG_DURATION("bm25"s);
+    double total_relevance = 0;
+    for (const string_view query : queries) {
+      for (const auto &document : search_server.FindTopDocuments<Bm25>(execution::seq, query)) {
+        total_relevance += document.relevance;
+      }
+    }
+    cout << total_relevance << endl;
+  }
+}
+
+void TestLoadCorpusBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 50000, 70);
+  const string path = (filesystem::temp_directory_path() / "search_server_benchmark_corpus.tsv"s).string();
+  {
+    ofstream out(path);
+    for (size_t i = 0; i < documents.size(); ++i) {
+      out << i << "\tACTUAL\t1 2 3\t"s << documents[i] << '\n';
+    }
+  }
+  {
+    SearchServer search_server(dictionary[0]);
+    LOG_DURATION("AddDocument"s);
+    ifstream in(path);
+    for (string line; getline(in, line);) {
+      const CorpusLine corpus_line = ParseCorpusLine(line);
+      search_server.AddDocument(corpus_line.id, corpus_line.text, corpus_line.status, corpus_line.ratings);
+    }
+  }
+  {
+    SearchServer search_server(dictionary[0]);
+    cout << LoadCorpus(search_server, path);
+  }
+  filesystem::remove(path);
+}
+
+void TestPreparedQueryBenchmark() {
+  mt19937 generator;
+  // Rare words keep scoring cheap, so parsing and word lookups are a visible part of a query
+  const auto dictionary = GenerateDictionary(generator, 100'000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  // A fixed monitoring query, run over and over
+  const string raw_query = "zzzz "s + GenerateQuery(generator, dictionary, 20, 0.3);
+  const SearchServer::PreparedQuery query = search_server.Prepare(raw_query);
+  // Words indexed after Prepare, the query has to look up the words it did not find
+  search_server.AddDocument(documents.size(), "yyyy"s, DocumentStatus::ACTUAL, {1, 2, 3});
+  {
+    LOG_DURATION("raw query"s);
+    size_t document_count = 0;
+    for (int i = 0; i < 100'000; ++i) {
+      document_count += search_server.FindTopDocuments(execution::seq, raw_query).size();
+    }
+    cout << document_count << endl;
+  }
+  {
+    LOG_DURATION("prepared query"s);
+    size_t document_count = 0;
+    for (int i = 0; i < 100'000; ++i) {
+      document_count += search_server.FindTopDocuments(execution::seq, query).size();
+    }
+    cout << document_count << endl;
+  }
+}
+
+void TestSegmentedIndexBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 20000, 70);
+  const auto queries = GenerateQueries(generator, dictionary, 100, 7);
+  {
+    SearchServer search_server(dictionary[0]);
+    {
+      LOG_DURATION("server add"s);
+      for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+      }
+    }
+    {
+      LOG_DURATION("server remove"s);
+      for (size_t i = 0; i < documents.size(); i += 4) {
+        search_server.RemoveDocument(i);
+      }
+    }
+    LOG_DURATION("server query"s);
+    size_t document_count = 0;
+    for (const string_view query : queries) {
+      document_count += search_server.FindTopDocuments(query).size();
+    }
+    cout << document_count << endl;
+  }
+  {
+    SegmentedIndex index(dictionary[0]);
+    {
+      LOG_DURATION("segmented add"s);
+      for (size_t i = 0; i < documents.size(); ++i) {
+        index.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+      }
+    }
+    {
+      LOG_DURATION("segmented remove"s);
+      for (size_t i = 0; i < documents.size(); i += 4) {
+        index.RemoveDocument(i);
+      }
+    }
+    index.WaitForMerges();
+    LOG_DURATION("segmented query"s);
+    size_t document_count = 0;
+    for (const string_view query : queries) {
+      document_count += index.FindTopDocuments(query).size();
+    }
+    cout << document_count << endl;
+  }
+}
+
+void TestImpactOrderedBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 20000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  search_server.BuildImpactIndex();
+  const auto queries = GenerateQueries(generator, dictionary, 1000, 5);
+
+  vector<vector<Document>> exact_results;
+  {
+    LOG_DURATION("exact"s);
+    for (const string_view query : queries) {
+      exact_results.push_back(search_server.FindTopDocuments(query));
+    }
+  }
+  // Quality is recall of the exact top documents
+  for (const size_t budget : {numeric_limits<size_t>::max(), size_t{1000}, size_t{100}, size_t{20}}) {
+    size_t found_count = 0;
+    size_t expected_count = 0;
+    {
+      LOG_DURATION("impact, budget "s + (budget == numeric_limits<size_t>::max() ? "unlimited"s : to_string(budget)));
+      for (size_t i = 0; i < queries.size(); ++i) {
+        for (const Document &document : search_server.FindTopDocumentsByImpact(queries[i], DocumentStatus::ACTUAL, budget)) {
+          found_count += any_of(exact_results[i].begin(), exact_results[i].end(), [&document](const Document &expected) {
+            return expected.id == document.id;
+          });
+        }
+        expected_count += exact_results[i].size();
+      }
+    }
+    cout << "recall: "s << found_count * 1.0 / expected_count << endl;
+  }
+}
+
+void TestTermFreqFidelityBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 2000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10000, 70);
+  const string_view stop_word = dictionary[0];
+  SearchServer search_server(stop_word);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+
+  // Exact reference engine: TF-IDF from word counts in double precision
+  map<string_view, vector<pair<int, double>>> word_to_document_freqs;
+  for (size_t i = 0; i < documents.size(); ++i) {
+    map<string_view, int> word_counts;
+    int word_count = 0;
+    for (const string_view word : SplitIntoWords(documents[i])) {
+      if (word != stop_word) {
+        ++word_counts[word];
+        ++word_count;
+      }
+    }
+    for (const auto [word, count] : word_counts) {
+      word_to_document_freqs[word].emplace_back(i, count * 1.0 / word_count);
+    }
+  }
+
+  const auto queries = GenerateQueries(generator, dictionary, 1000, 5);
+  size_t found_count = 0;
+  size_t expected_count = 0;
+  for (const string &query : queries) {
+    map<int, double> document_to_relevance;
+    const vector<string_view> query_words = SplitIntoWords(query);
+    for (const string_view word : set<string_view>(query_words.begin(), query_words.end())) {
+      const auto word_it = word_to_document_freqs.find(word);
+      if (word == stop_word || word_it == word_to_document_freqs.end()) {
+        continue;
+      }
+      const double inverse_document_freq = log(documents.size() * 1.0 / word_it->second.size());
+      for (const auto &[document_id, term_freq] : word_it->second) {
+        document_to_relevance[document_id] += term_freq * inverse_document_freq;
+      }
+    }
+    vector<Document> expected_docs;
+    for (const auto [document_id, relevance] : document_to_relevance) {
+      expected_docs.push_back({document_id, relevance, 2});
+    }
+    sort(expected_docs.begin(), expected_docs.end(), [](const Document &lhs, const Document &rhs) {
+      return abs(lhs.relevance - rhs.relevance) < ERROR_MARGIN ? lhs.id < rhs.id : lhs.relevance > rhs.relevance;
+    });
+    expected_docs.resize(min<size_t>(expected_docs.size(), MAX_RESULT_DOCUMENT_COUNT));
+    for (const Document &document : search_server.FindTopDocuments(query)) {
+      found_count += any_of(expected_docs.begin(), expected_docs.end(), [&document](const Document &expected) {
+        return expected.id == document.id;
+      });
+    }
+    expected_count += expected_docs.size();
+  }
+  cout << "term frequency bytes: "s << sizeof(TermFreq) << ", posting bytes: "s << sizeof(pair<const int, TermFreq>)
+       << ", top-"s << MAX_RESULT_DOCUMENT_COUNT << " overlap: "s << found_count * 1.0 / expected_count << endl;
+}
+
+void TestQueryDeadlineBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 1000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  vector<string> queries;
+  for (int i = 0; i < 20; ++i) {
+    queries.push_back(GenerateQuery(generator, dictionary, 500, 0.1));
+  }
+
+  {
+    LOG_DURATION("no deadline"s);
+    size_t document_count = 0;
+    for (const string &query : queries) {
+      document_count += search_server.FindTopDocuments(execution::seq, query).size();
+    }
+    cout << document_count << endl;
+  }
+  {
+    LOG_DURATION("unbounded deadline"s);
+    size_t document_count = 0;
+    for (const string &query : queries) {
+      document_count += search_server.FindTopDocuments(
+          execution::seq, query, DocumentStatus::ACTUAL, {}, QueryDeadline()).documents.size();
+    }
+    cout << document_count << endl;
+  }
+  {
+    LOG_DURATION("5 ms deadline"s);
+    size_t truncated_count = 0;
+    QueryDeadline::Clock::duration max_latency{};
+    for (const string &query : queries) {
+      const auto start = QueryDeadline::Clock::now();
+      truncated_count += search_server.FindTopDocuments(
+          execution::seq, query, DocumentStatus::ACTUAL, {}, QueryDeadline(5ms)).is_truncated;
+      max_latency = max(max_latency, QueryDeadline::Clock::now() - start);
+    }
+    cout << "truncated: "s << truncated_count << " of "s << queries.size() << ", max latency: "s
+         << chrono::duration_cast<chrono::milliseconds>(max_latency).count() << " ms"s << endl;
+  }
+}
+
+void TestRequestQueueOverloadBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 1000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+
+  // Eight clients offer more load than the server can serve, a tenth of it high priority
+  for (const size_t queue_capacity : {size_t{1000}, size_t{4}}) {
+    AdmissionOptions options;
+    options.queue_capacity = queue_capacity;
+    options.max_queue_wait = chrono::seconds(10);
+    RequestQueue request_queue(search_server, options);
+    {
+      LOG_DURATION("queue capacity "s + to_string(queue_capacity));
+      vector<thread> clients;
+      for (int i = 0; i < 8; ++i) {
+        clients.emplace_back([&request_queue, &queries, i] {
+          for (size_t j = 0; j < queries.size(); ++j) {
+            const RequestPriority priority = (i + j) % 10 == 0 ? RequestPriority::HIGH : RequestPriority::NORMAL;
+            request_queue.SubmitFindRequest(queries[j], DocumentStatus::ACTUAL, priority);
+          }
+        });
+      }
+      for (thread &client : clients) {
+        client.join();
+      }
+    }
+    const AdmissionStats stats = request_queue.GetAdmissionStats();
+    const uint64_t admitted_count = accumulate(stats.admitted_counts.begin(), stats.admitted_counts.end(), uint64_t{0});
+    const uint64_t rejected_count = accumulate(stats.rejected_counts.begin(), stats.rejected_counts.end(), uint64_t{0});
+    using chrono::duration_cast;
+    using chrono::microseconds;
+    cout << "admitted: "s << admitted_count << ", rejected: "s << rejected_count
+         << ", mean queue wait: "s << duration_cast<microseconds>(stats.total_queue_wait).count() / (admitted_count + rejected_count)
+         << " us, mean service time: "s << duration_cast<microseconds>(stats.total_service_time).count() / admitted_count
+         << " us, limit: "s << stats.concurrency_limit << endl;
+  }
+}
+
+void TestStopWordSetBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10000, 10);
+  const set<string, less<>> words(dictionary.begin(), dictionary.begin() + 500);
+  const StopWordSet stop_words(words);
+  vector<string_view> tokens;
+  const auto documents = GenerateQueries(generator, dictionary, 20000, 70);
+  for (const string &document : documents) {
+    for (const string_view token : SplitIntoWords(document)) {
+      tokens.push_back(token);
+    }
+  }
+  for (int i = 0; i < 2; ++i) {
+    LOG_DURATION(i == 0 ? "stop words in std::set"s : "stop words in StopWordSet"s);
+    size_t stop_word_count = 0;
+    for (const string_view token : tokens) {
+      stop_word_count += i == 0 ? words.count(token) : stop_words.Contains(token);
+    }
+    cout << stop_word_count << " of "s << tokens.size() << endl;
+  }
+  {
+    LOG_DURATION("ingest with 500 stop words"s);
+    SearchServer search_server(words);
+    for (size_t i = 0; i < documents.size(); ++i) {
+      search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1});
+    }
+  }
+}
+
+void TestTextAnalyzerBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10000, 10);
+  // Words get random capitals and trailing punctuation, as in real text
+  string text;
+  uniform_int_distribution<int> variant_distribution(0, 7);
+  const auto documents = GenerateQueries(generator, dictionary, 20000, 70);
+  for (const string &document : documents) {
+    for (const string_view word : SplitIntoWords(document)) {
+      string mixed_word(word);
+      const int variant = variant_distribution(generator);
+      if (variant == 0) {
+        transform(mixed_word.begin(), mixed_word.end(), mixed_word.begin(), [](char c) {
+          return static_cast<char>(toupper(c));
+        });
+      } else if (variant == 1) {
+        mixed_word[0] = static_cast<char>(toupper(mixed_word[0]));
+      } else if (variant == 2) {
+        mixed_word += ","s;
+      }
+      text += mixed_word;
+      text += ' ';
+    }
+  }
+  const double megabytes = text.size() / 1e6;
+  const TextAnalyzer analyzer{AnalyzerOptions{}};
+  const auto count_vocabulary = [](string_view normalized_text) {
+    const vector<string_view> words = SplitIntoWords(normalized_text);
+    return set<string_view>(words.begin(), words.end()).size();
+  };
+  cout << "mixed case corpus: "s << megabytes << " MB, vocabulary "s << count_vocabulary(text)
+       << " raw, "s << count_vocabulary(analyzer.Normalize(text)) << " normalized"s << endl;
+  {
+    LOG_DURATION("split only, 10 passes"s);
+    size_t word_count = 0;
+    for (int i = 0; i < 10; ++i) {
+      word_count += SplitIntoWords(text).size();
+    }
+    cout << word_count << endl;
+  }
+  {
+    LOG_DURATION("normalize and split, 10 passes"s);
+    size_t word_count = 0;
+    for (int i = 0; i < 10; ++i) {
+      word_count += SplitIntoWords(analyzer.Normalize(text)).size();
+    }
+    cout << word_count << endl;
+  }
+  // Two-byte characters in every word take the per-character path
+  string cyrillic_text;
+  for (size_t i = 0; i < text.size() && cyrillic_text.size() < text.size(); ++i) {
+    cyrillic_text += text[i] == ' ' ? " "s : "К"s;
+  }
+  AnalyzerOptions fold_options;
+  fold_options.fold_utf8_case = true;
+  const TextAnalyzer fold_analyzer(fold_options);
+  {
+    LOG_DURATION("normalize two-byte text, 10 passes"s);
+    size_t byte_count = 0;
+    for (int i = 0; i < 10; ++i) {
+      byte_count += fold_analyzer.Normalize(cyrillic_text).size();
+    }
+    cout << byte_count << endl;
+  }
+}
+
+void TestTracerBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 1000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+  TEST_FIND_TOP_DOCUMENTS(par);
+  Tracer::Clear();
+  Tracer::Start();
+  {
+    LOG_DURATION("par, traced"s);
+    cout << ProcessQueriesJoined(search_server, queries).size() << endl;
+  }
+  Tracer::Stop();
+  const filesystem::path path = filesystem::temp_directory_path() / "search_server_trace.json"s;
+  ofstream(path) << [] {
+    ostringstream trace;
+    Tracer::WriteChromeTrace(trace);
+    return trace.str();
+  }();
+  cout << Tracer::GetEventCount() << " trace events written to "s << path.string() << endl;
+  Tracer::Clear();
+}
+
+void TestConcurrentMapContentionBenchmark() {
+  const size_t thread_count = 4;
+  const size_t key_count = 100'000;
+  const size_t bucket_count = ConcurrentMap<int, double>::ChooseBucketCount(key_count, thread_count);
+  mt19937 generator;
+  // Zipf-like popularity: key k is drawn with weight 1 / (k + 1)
+  vector<double> weights(key_count);
+  for (size_t k = 0; k < key_count; ++k) {
+    weights[k] = 1.0 / (k + 1);
+  }
+  discrete_distribution<int> zipf(weights.begin(), weights.end());
+  vector<pair<string, vector<int>>> distributions(3);
+  distributions[0].first = "sequential"s;
+  distributions[1].first = "bucket stride"s;
+  distributions[2].first = "zipf"s;
+  for (size_t i = 0; i < 400'000; ++i) {
+    distributions[0].second.push_back(i % key_count);
+    distributions[1].second.push_back(i % key_count * bucket_count);
+    distributions[2].second.push_back(zipf(generator));
+  }
+
+  for (const auto &[name, keys] : distributions) {
+    // Share of the busiest bucket with key % bucket_count placement for comparison
+    vector<size_t> modulo_loads(bucket_count);
+    for (const int key : keys) {
+      ++modulo_loads[key % bucket_count];
+    }
+    ConcurrentMap<int, double> concurrent_map(bucket_count);
+    concurrent_map.EnableContentionStats();
+    {
+      LOG_DURATION(name + " keys, "s + to_string(thread_count) + " threads, "s + to_string(bucket_count) + " buckets"s);
+      vector<thread> threads;
+      for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&concurrent_map, &keys = keys, t, thread_count] {
+          for (size_t i = t; i < keys.size(); i += thread_count) {
+            concurrent_map[keys[i]].ref_to_value += 1;
+          }
+        });
+      }
+      for (thread &worker : threads) {
+        worker.join();
+      }
+    }
+    uint64_t max_acquire_count = 0;
+    uint64_t contended_count = 0;
+    chrono::nanoseconds wait_time{};
+    for (const BucketContention &bucket : concurrent_map.GetContentionStats()) {
+      max_acquire_count = max(max_acquire_count, bucket.acquire_count);
+      contended_count += bucket.contended_count;
+      wait_time += bucket.wait_time;
+    }
+    cout << "busiest bucket share: modulo "s << *max_element(modulo_loads.begin(), modulo_loads.end()) * 1.0 / keys.size()
+         << ", hashed "s << max_acquire_count * 1.0 / keys.size()
+         << "; contended: "s << contended_count << " of "s << keys.size()
+         << ", wait: "s << chrono::duration_cast<chrono::microseconds>(wait_time).count() << " us"s << endl;
+  }
+}
+
+void TestConcurrentHashMapScalingBenchmark() {
+  const size_t key_count = 100'000;
+  const size_t addition_count = 1'600'000;
+  mt19937 generator;
+  uniform_int_distribution<int> key_distribution(0, key_count - 1);
+  vector<int> keys(addition_count);
+  for (int &key : keys) {
+    key = key_distribution(generator);
+  }
+  // Adds every key once in total, split over the threads
+  const auto run = [&keys](size_t thread_count, auto add) {
+    vector<thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&keys, &add, t, thread_count] {
+        for (size_t i = t; i < keys.size(); i += thread_count) {
+          add(keys[i]);
+        }
+      });
+    }
+    for (thread &worker : threads) {
+      worker.join();
+    }
+  };
+
+  for (size_t thread_count = 1; thread_count <= 64; thread_count *= 2) {
+    size_t lock_free_size = 0;
+    size_t locked_size = 0;
+    {
+      LOG_DURATION("lock-free, "s + to_string(thread_count) + " threads"s);
+      ConcurrentHashMap<int, double> concurrent_map(key_count);
+      run(thread_count, [&concurrent_map](int key) {
+        concurrent_map.FetchAdd(key, 1);
+      });
+      lock_free_size = concurrent_map.Drain(execution::par).size();
+    }
+    {
+      LOG_DURATION("bucket locks, "s + to_string(thread_count) + " threads"s);
+      ConcurrentMap<int, double> concurrent_map(ConcurrentMap<int, double>::ChooseBucketCount(key_count, thread_count));
+      run(thread_count, [&concurrent_map](int key) {
+        concurrent_map[key].ref_to_value += 1;
+      });
+      locked_size = concurrent_map.BuildOrdinaryMap().size();
+    }
+    ASSERT_EQUAL(lock_free_size, locked_size);
+  }
+}
+
+void TestLoadTesterBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 20'000, 70);
+  const filesystem::path directory = filesystem::temp_directory_path();
+  const string corpus_path = (directory / "search_server_benchmark_corpus.tsv"s).string();
+  {
+    ofstream out(corpus_path);
+    for (size_t i = 0; i < documents.size(); ++i) {
+      out << i << "\tACTUAL\t1 2 3\t"s << documents[i] << '\n';
+    }
+  }
+  SearchServer search_server(dictionary[0]);
+  LoadCorpus(search_server, corpus_path);
+  filesystem::remove(corpus_path);
+
+  // Query popularity is Zipfian: distinct query k is logged with weight 1 / (k + 1)
+  const auto distinct_queries = GenerateQueries(generator, dictionary, 1000, 5);
+  vector<double> weights(distinct_queries.size());
+  for (size_t k = 0; k < weights.size(); ++k) {
+    weights[k] = 1.0 / (k + 1);
+  }
+  discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+  const string log_path = (directory / "search_server_benchmark_queries.log"s).string();
+  {
+    ofstream out(log_path);
+    for (int i = 0; i < 5000; ++i) {
+      out << distinct_queries[zipf(generator)] << '\n';
+    }
+  }
+  const vector<string> queries = ReadQueryLog(log_path);
+  filesystem::remove(log_path);
+
+  LoadTestOptions options;
+  options.request_count = 5000;
+  for (const size_t client_count : {size_t{1}, size_t{8}}) {
+    options.client_count = client_count;
+    cout << client_count << " clients, "s << RunLoadTest(search_server, queries, options);
+  }
+  // Below and above the capacity measured in closed loop
+  options.mode = LoadMode::OPEN_LOOP;
+  options.client_count = 8;
+  options.request_count = 2000;
+  for (const double arrival_rate : {1000.0, 20'000.0}) {
+    options.arrival_rate = arrival_rate;
+    cout << arrival_rate << " queries/s offered, "s << RunLoadTest(search_server, queries, options);
+  }
+}
+
+void TestServingIndexSwapBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+  const auto queries = GenerateQueries(generator, dictionary, 1000, 5);
+  const auto build = [&dictionary, &documents] {
+    auto search_server = make_unique<SearchServer>(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+      search_server->AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    return search_server;
+  };
+
+  // Readers query the current version while a rebuilt one is swapped in after the first third
+  const auto run = [&queries](const string &name, auto find, auto swap) {
+    const auto deadline = chrono::steady_clock::now() + chrono::seconds(3);
+    atomic<bool> is_swap_due = false;
+    vector<vector<chrono::nanoseconds>> reader_latencies(4);
+    vector<thread> readers;
+    for (size_t reader = 0; reader < reader_latencies.size(); ++reader) {
+      readers.emplace_back([&, reader] {
+        for (size_t i = reader; chrono::steady_clock::now() < deadline; i += reader_latencies.size()) {
+          const auto start = chrono::steady_clock::now();
+          find(queries[i % queries.size()]);
+          reader_latencies[reader].push_back(chrono::steady_clock::now() - start);
+        }
+      });
+    }
+    this_thread::sleep_for(chrono::seconds(1));
+    swap();
+    for (thread &reader : readers) {
+      reader.join();
+    }
+    vector<chrono::nanoseconds> latencies;
+    for (const auto &part : reader_latencies) {
+      latencies.insert(latencies.end(), part.begin(), part.end());
+    }
+    sort(latencies.begin(), latencies.end());
+    const auto to_us = [](chrono::nanoseconds latency) {
+      return chrono::duration_cast<chrono::microseconds>(latency).count();
+    };
+    cout << name << ": "s << latencies.size() << " queries, p999 "s << to_us(latencies[latencies.size() * 999 / 1000])
+         << " us, max "s << to_us(latencies.back()) << " us"s << endl;
+  };
+
+  {
+    // Last reader of the old version tears it down inside its query
+    shared_ptr<const SearchServer> current = build();
+    auto next = shared_ptr<const SearchServer>(build());
+    run("inline teardown"s, [&current](const string &query) {
+      const shared_ptr<const SearchServer> search_server = atomic_load(&current);
+      search_server->FindTopDocuments(query);
+    }, [&current, &next] {
+      atomic_store(&current, move(next));
+    });
+  }
+  {
+    ServingIndex index(build());
+    auto next = build();
+    run("ServingIndex"s, [&index](const string &query) {
+      index.FindTopDocuments(query);
+    }, [&index, &next] {
+      index.Publish(move(next));
+    });
+  }
+}
+
+void TestAutoExecutionBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 20'000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  {
+    LOG_DURATION("calibration"s);
+    const ExecutionCalibration calibration = search_server.CalibrateExecution();
+    cout << "parallel from "s << calibration.min_parallel_posting_count << " postings, "s
+         << calibration.postings_per_thread << " per thread, up to "s << calibration.max_thread_count << " threads"s << endl;
+  }
+  // Short queries over rare words and long ones over every word
+  vector<pair<string, vector<string>>> workloads(2);
+  workloads[0].first = "2 words"s;
+  workloads[0].second = GenerateQueries(generator, dictionary, 2000, 2);
+  workloads[1].first = "50 words"s;
+  workloads[1].second = GenerateQueries(generator, dictionary, 100, 50);
+  for (const auto &[name, queries] : workloads) {
+    const auto run = [&search_server, &queries = queries](const string &mark, const auto &policy) {
+      LOG_DURATION(mark);
+      size_t document_count = 0;
+      for (const string &query : queries) {
+        document_count += search_server.FindTopDocuments(policy, query).size();
+      }
+      cout << document_count << endl;
+    };
+    run(name + ", seq"s, execution::seq);
+    run(name + ", par"s, execution::par);
+    run(name + ", auto"s, auto_execution);
+  }
+}
+
+void TestPartitionedExecutionBenchmark() {
+  mt19937 generator;
+  const auto dictionary = GenerateDictionary(generator, 1000, 10);
+  const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+  SearchServer search_server(dictionary[0]);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+  }
+  // Three words of a small dictionary, each in about a fifth of the documents
+  const auto queries = GenerateQueries(generator, dictionary, 100, 3);
+  const auto run = [&search_server, &queries](const string &mark, const auto &policy) {
+    LOG_DURATION(mark);
+    double relevance = 0;
+    for (const string &query : queries) {
+      for (const Document &document : search_server.FindTopDocuments(policy, query)) {
+        relevance += document.relevance;
+      }
+    }
+    cout << relevance << endl;
+  };
+  run("seq"s, execution::seq);
+  run("par"s, execution::par);
+  run("partitioned"s, partitioned_execution);
+  run("partitioned, 16 partitions"s, PartitionedExecutionPolicy{16});
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <random>
 #include <string>
 
 void TestExamplePaginator();
@@ -56,22 +57,74 @@ void TestFindTopDocumentsByLambda();
 
 void TestFindTopDocumentsByStatus();
 
+void TestSetDocumentStatus();
+
+void TestFindTopDocumentsByFilterExpression();
+
+void TestSparseDocumentIds();
+
+void TestPhraseQuery();
+
+void TestPrefixQuery();
+
+void TestFuzzyQuery();
+
 void TestExcludeDocumentsWithMinusWordsFromFoundDocuments();
 
 void TestComputeRelevance();
 
+void TestComputeBm25Relevance();
+
+void TestQuantizedTermFreq();
+
 void TestComputeAverageRating();
 
 void TestSortByRelevance();
 
 void TestGetDocumentCount();
 
+void TestFindTopDocumentsPage();
+
 void TestMatchDocument1();
 
 void TestMatchDocumentWithMinusWords();
 
+void TestMatchDocuments();
+
+void TestQueryDeadline();
+
+void TestRequestQueueAdmission();
+
+void TestPreparedQuery();
+
+void TestFindTopDocumentsByImpact();
+
+void TestRemoveDocumentWithTombstone();
+
 void TestSplitIntoWords();
 
+void TestStopWordSet();
+
+void TestTextAnalyzer();
+
+void TestTracer();
+
+void TestConcurrentMap();
+
+void TestConcurrentHashMap();
+
+void TestLoadTester();
+
+void TestServingIndex();
+
+void TestAutoExecution();
+
+void TestPartitionedExecution();
+
+void TestLoadCorpus();
+
+void TestSegmentedIndex();
+
 // Launch tests
 void TestSearchServer();
 
@@ -114,3 +167,43 @@ void TestFindTopDocumentsWithPolicy(std::string_view mark,
                                     const std::vector<std::string> &queries,
                                     ExecutionPolicy &&policy);
 void TestFindTopDocuments2();
+
+void TestFindTopDocumentsByRatingFilter();
+
+void TestPhraseQueryBenchmark();
+
+void TestFuzzyQueryBenchmark();
+
+void TestScoringModelBenchmark();
+
+void TestLoadCorpusBenchmark();
+
+void TestPreparedQueryBenchmark();
+
+void TestSegmentedIndexBenchmark();
+
+void TestImpactOrderedBenchmark();
+
+void TestTermFreqFidelityBenchmark();
+
+void TestQueryDeadlineBenchmark();
+
+void TestRequestQueueOverloadBenchmark();
+
+void TestStopWordSetBenchmark();
+
+void TestTextAnalyzerBenchmark();
+
+void TestTracerBenchmark();
+
+void TestConcurrentMapContentionBenchmark();
+
+void TestConcurrentHashMapScalingBenchmark();
+
+void TestLoadTesterBenchmark();
+
+void TestServingIndexSwapBenchmark();
+
+void TestAutoExecutionBenchmark();
+
+void TestPartitionedExecutionBenchmark();
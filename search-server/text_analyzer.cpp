@@ -0,0 +1,130 @@
+#include "text_analyzer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+bool IsAsciiPunctuation(char c) {
+  return c >= '!' && c <= '~'
+      && !(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z') && !(c >= '0' && c <= '9');
+}
+
+// Simple case folding of the capitals whose lowercase letters also take two bytes in UTF-8
+uint32_t FoldCase(uint32_t code_point) {
+  if ((code_point >= 0xC0 && code_point <= 0xDE && code_point != 0xD7)
+      || (code_point >= 0x391 && code_point <= 0x3A9 && code_point != 0x3A2)
+      || (code_point >= 0x410 && code_point <= 0x42F)) {
+    return code_point + 0x20;
+  }
+  if (code_point >= 0x400 && code_point <= 0x40F) {
+    return code_point + 0x50;
+  }
+  return code_point;
+}
+
+bool IsWordBoundary(string_view text, size_t index) {
+  return index >= text.size() || text[index] == ' ' || text[index] == '"';
+}
+
+}  // namespace
+
+TextAnalyzer::TextAnalyzer(const AnalyzerOptions &options)
+    : options_(options),
+      is_identity_(!options.lowercase && !options.strip_punctuation && !options.fold_utf8_case) {
+}
+
+bool TextAnalyzer::IsIdentity() const {
+  return is_identity_;
+}
+
+string TextAnalyzer::Normalize(string_view text) const {
+  string normalized(text);
+  if (is_identity_) {
+    return normalized;
+  }
+  for (size_t i = 0; i < normalized.size();) {
+    i = NormalizeAsciiBlocks(normalized, i);
+    // A block with multibyte characters is normalized one character at a time
+    const size_t block_end = min(normalized.size(), i + 16);
+    while (i < block_end) {
+      i = NormalizeCharacter(normalized, i);
+    }
+  }
+  return normalized;
+}
+
+string TextAnalyzer::NormalizeQuery(string_view text) const {
+  string normalized(text);
+  if (is_identity_) {
+    return normalized;
+  }
+  for (size_t i = 0; i < normalized.size();) {
+    const char c = text[i];
+    const bool is_syntax = c == '"'
+        || (c == '-' && (i == 0 || IsWordBoundary(text, i - 1)))
+        || (c == '*' && IsWordBoundary(text, i + 1))
+        || (c == '~' && (IsWordBoundary(text, i + 1)
+            || (text[i + 1] >= '0' && text[i + 1] <= '9' && IsWordBoundary(text, i + 2))));
+    i = is_syntax ? i + 1 : NormalizeCharacter(normalized, i);
+  }
+  return normalized;
+}
+
+size_t TextAnalyzer::NormalizeAsciiBlocks(string &text, size_t begin) const {
+  size_t i = begin;
+#if defined(__SSE2__)
+  const auto in_range = [](__m128i block, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(low - 1)),
+                         _mm_cmplt_epi8(block, _mm_set1_epi8(high + 1)));
+  };
+  const __m128i case_offset = _mm_set1_epi8(options_.lowercase ? 'a' - 'A' : 0);
+  const __m128i punctuation_mask = _mm_set1_epi8(options_.strip_punctuation ? -1 : 0);
+  const __m128i spaces = _mm_set1_epi8(' ');
+  for (; i + 16 <= text.size(); i += 16) {
+    auto *data = reinterpret_cast<__m128i *>(text.data() + i);
+    __m128i block = _mm_loadu_si128(data);
+    // Bytes of multibyte characters have the high bit set
+    if (_mm_movemask_epi8(block)) {
+      break;
+    }
+    const __m128i upper = in_range(block, 'A', 'Z');
+    const __m128i alphanumeric = _mm_or_si128(_mm_or_si128(upper, in_range(block, 'a', 'z')),
+                                              in_range(block, '0', '9'));
+    const __m128i punctuation = _mm_and_si128(_mm_andnot_si128(alphanumeric, in_range(block, '!', '~')),
+                                              punctuation_mask);
+    block = _mm_add_epi8(block, _mm_and_si128(upper, case_offset));
+    block = _mm_or_si128(_mm_andnot_si128(punctuation, block), _mm_and_si128(punctuation, spaces));
+    _mm_storeu_si128(data, block);
+  }
+#endif
+  return i;
+}
+
+size_t TextAnalyzer::NormalizeCharacter(string &text, size_t index) const {
+  const char c = text[index];
+  if (static_cast<uint8_t>(c) < 0x80) {
+    if (options_.lowercase && c >= 'A' && c <= 'Z') {
+      text[index] = static_cast<char>(c - 'A' + 'a');
+    } else if (options_.strip_punctuation && IsAsciiPunctuation(c)) {
+      text[index] = ' ';
+    }
+    return index + 1;
+  }
+  const auto lead = static_cast<uint8_t>(c);
+  if (options_.fold_utf8_case && (lead & 0xE0) == 0xC0 && index + 1 < text.size()
+      && (static_cast<uint8_t>(text[index + 1]) & 0xC0) == 0x80) {
+    const uint32_t code_point = FoldCase((lead & 0x1Fu) << 6 | (static_cast<uint8_t>(text[index + 1]) & 0x3Fu));
+    text[index] = static_cast<char>(0xC0 | code_point >> 6);
+    text[index + 1] = static_cast<char>(0x80 | (code_point & 0x3F));
+    return index + 2;
+  }
+  // Other bytes of multibyte characters are kept as they are
+  return index + 1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+struct AnalyzerOptions {
+  // ASCII capitals are lowercased
+  bool lowercase = true;
+  // ASCII punctuation separates words like a space
+  bool strip_punctuation = true;
+  // Two-byte UTF-8 capitals of Latin-1, Greek and Cyrillic are lowercased too
+  bool fold_utf8_case = false;
+};
+
+// Normalizes text byte by byte before it is split into words. Every step keeps the length of
+// the text, so word positions are the same in the raw and the normalized text. Blocks of
+// ASCII text are normalized 16 bytes at a time where SSE2 is available
+class TextAnalyzer {
+ public:
+  // Leaves text unchanged
+  TextAnalyzer() = default;
+
+  explicit TextAnalyzer(const AnalyzerOptions &options);
+
+  bool IsIdentity() const;
+
+  std::string Normalize(std::string_view text) const;
+
+  // Same as Normalize, but keeps the query syntax: '-' starting a word, '*' ending it,
+  // '~' with an optional distance digit ending it and double quotes
+  std::string NormalizeQuery(std::string_view text) const;
+
+ private:
+  AnalyzerOptions options_;
+  bool is_identity_ = true;
+
+  // Normalizes whole blocks of ASCII text from begin on, returns where it stopped
+  size_t NormalizeAsciiBlocks(std::string &text, size_t begin) const;
+
+  // Normalizes the character at index, returns the index of the next one
+  size_t NormalizeCharacter(std::string &text, size_t index) const;
+};
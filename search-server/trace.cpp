@@ -0,0 +1,161 @@
+#include "trace.h"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct TraceEvent {
+  const char *name;
+  Tracer::Clock::time_point begin;
+  Tracer::Clock::time_point end;
+};
+
+const size_t TRACE_CHUNK_EVENT_COUNT = 4096;
+
+// Events beyond this many per thread are dropped
+const size_t MAX_TRACE_CHUNK_COUNT = 1024;
+
+struct TraceChunk {
+  array<TraceEvent, TRACE_CHUNK_EVENT_COUNT> events;
+};
+
+// Written by its thread only. Chunks are published before the event count that covers
+// them, so a reader that loads the count first sees complete events
+struct ThreadTraceBuffer {
+  int thread_id = 0;
+  array<atomic<TraceChunk *>, MAX_TRACE_CHUNK_COUNT> chunks{};
+  atomic<size_t> event_count = 0;
+
+  ~ThreadTraceBuffer() {
+    for (atomic<TraceChunk *> &chunk : chunks) {
+      delete chunk.load();
+    }
+  }
+};
+
+// Buffers outlive their threads, so events of finished threads can still be written out
+struct TraceRegistry {
+  mutex buffers_mutex;
+  vector<unique_ptr<ThreadTraceBuffer>> buffers;
+  Tracer::Clock::time_point origin;
+  bool has_origin = false;
+};
+
+TraceRegistry &GetTraceRegistry() {
+  static TraceRegistry registry;
+  return registry;
+}
+
+ThreadTraceBuffer &GetThreadTraceBuffer() {
+  thread_local ThreadTraceBuffer *buffer = [] {
+    TraceRegistry &registry = GetTraceRegistry();
+    lock_guard guard(registry.buffers_mutex);
+    registry.buffers.push_back(make_unique<ThreadTraceBuffer>());
+    registry.buffers.back()->thread_id = static_cast<int>(registry.buffers.size());
+    return registry.buffers.back().get();
+  }();
+  return *buffer;
+}
+
+void WriteJsonString(ostream &os, const char *text) {
+  os << '"';
+  for (; *text; ++text) {
+    if (*text == '"' || *text == '\\') {
+      os << '\\';
+    }
+    os << *text;
+  }
+  os << '"';
+}
+
+}  // namespace
+
+atomic<bool> Tracer::is_recording_ = false;
+
+void Tracer::Start() {
+  TraceRegistry &registry = GetTraceRegistry();
+  {
+    lock_guard guard(registry.buffers_mutex);
+    if (!registry.has_origin) {
+      registry.origin = Clock::now();
+      registry.has_origin = true;
+    }
+  }
+  is_recording_.store(true, memory_order_relaxed);
+}
+
+void Tracer::Stop() {
+  is_recording_.store(false, memory_order_relaxed);
+}
+
+void Tracer::Clear() {
+  TraceRegistry &registry = GetTraceRegistry();
+  lock_guard guard(registry.buffers_mutex);
+  for (const auto &buffer : registry.buffers) {
+    buffer->event_count.store(0, memory_order_relaxed);
+  }
+}
+
+size_t Tracer::GetEventCount() {
+  TraceRegistry &registry = GetTraceRegistry();
+  lock_guard guard(registry.buffers_mutex);
+  size_t event_count = 0;
+  for (const auto &buffer : registry.buffers) {
+    event_count += buffer->event_count.load(memory_order_acquire);
+  }
+  return event_count;
+}
+
+void Tracer::Record(const char *name, Clock::time_point begin, Clock::time_point end) {
+  ThreadTraceBuffer &buffer = GetThreadTraceBuffer();
+  const size_t event_index = buffer.event_count.load(memory_order_relaxed);
+  const size_t chunk_index = event_index / TRACE_CHUNK_EVENT_COUNT;
+  if (chunk_index >= MAX_TRACE_CHUNK_COUNT) {
+    return;
+  }
+  TraceChunk *chunk = buffer.chunks[chunk_index].load(memory_order_relaxed);
+  if (!chunk) {
+    chunk = new TraceChunk;
+    buffer.chunks[chunk_index].store(chunk, memory_order_relaxed);
+  }
+  chunk->events[event_index % TRACE_CHUNK_EVENT_COUNT] = {name, begin, end};
+  buffer.event_count.store(event_index + 1, memory_order_release);
+}
+
+void Tracer::WriteChromeTrace(ostream &os) {
+  TraceRegistry &registry = GetTraceRegistry();
+  lock_guard guard(registry.buffers_mutex);
+  const auto to_microseconds = [](Clock::duration duration) {
+    return chrono::duration<double, micro>(duration).count();
+  };
+  const ios_base::fmtflags flags = os.flags(ios_base::fixed);
+  const streamsize precision = os.precision(3);
+  os << "{\"traceEvents\":["s;
+  bool is_first = true;
+  for (const auto &buffer : registry.buffers) {
+    const size_t event_count = buffer->event_count.load(memory_order_acquire);
+    if (event_count == 0) {
+      continue;
+    }
+    os << (is_first ? ""s : ","s) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"s
+       << buffer->thread_id << ",\"args\":{\"name\":\"thread "s << buffer->thread_id << "\"}}"s;
+    is_first = false;
+    for (size_t i = 0; i < event_count; ++i) {
+      const TraceEvent &event = buffer->chunks[i / TRACE_CHUNK_EVENT_COUNT].load(memory_order_relaxed)
+          ->events[i % TRACE_CHUNK_EVENT_COUNT];
+      os << ",{\"name\":"s;
+      WriteJsonString(os, event.name);
+      os << ",\"ph\":\"X\",\"pid\":1,\"tid\":"s << buffer->thread_id
+         << ",\"ts\":"s << to_microseconds(event.begin - registry.origin)
+         << ",\"dur\":"s << to_microseconds(event.end - event.begin) << '}';
+    }
+  }
+  os << "],\"displayTimeUnit\":\"ms\"}"s;
+  os.flags(flags);
+  os.precision(precision);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "log_duration.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#define TRACE_SCOPE(name) TraceScope PROFILE_CONCAT(traceScope, __LINE__)(name)
+
+// Opt-in recorder of timed scopes for the Chrome trace-event format, viewable in Perfetto.
+// Every thread appends to its own growable buffer without locks. Start, Stop and Clear
+// must not race with traced work, WriteChromeTrace may
+class Tracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Timestamps are relative to the first Start
+  static void Start();
+
+  static void Stop();
+
+  static bool IsRecording() {
+    return is_recording_.load(std::memory_order_relaxed);
+  }
+
+  // Drops the recorded events
+  static void Clear();
+
+  static size_t GetEventCount();
+
+  static void WriteChromeTrace(std::ostream &os);
+
+  // Name must be a string literal or otherwise outlive the tracer
+  static void Record(const char *name, Clock::time_point begin, Clock::time_point end);
+
+ private:
+  static std::atomic<bool> is_recording_;
+};
+
+// Records a scope while the tracer is recording, costs a flag check otherwise
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name) {
+    if (Tracer::IsRecording()) {
+      name_ = name;
+      begin_ = Tracer::Clock::now();
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  ~TraceScope() {
+    if (name_) {
+      Tracer::Record(name_, begin_, Tracer::Clock::now());
+    }
+  }
+
+ private:
+  const char *name_ = nullptr;
+  Tracer::Clock::time_point begin_;
+};